@@ -0,0 +1,629 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "graphics.h"
+#include "packed.h"
+#include "spatial.h"
+#include "tilemap.h"
+
+#define BENCH_FRAMES 200
+#define BENCH_CAPTURE_FILE "BENCH.CAP"
+#define BENCH_KEYFRAME_INTERVAL 70
+#define BENCH_SHAPES 500
+#define BENCH_POLYGON_SIDES 64
+#define BENCH_TILE_SIZE 16
+#define BENCH_TILE_COUNT 16
+#define BENCH_MAP_SIZE 64
+#define BENCH_SCENE_SHAPES 2000
+#define BENCH_POLYGON_BLOCK 64 /* polygons per allocation, as large scenes outgrow a 16-bit size_t */
+#define BENCH_SCENE_SCREENS 8 /* scene size, in screens along each axis */
+#define BENCH_SCENE_FRAMES 10
+#define BENCH_CELL_SIZE 32
+#define BENCH_HIT_TESTS 200
+#define BENCH_PACKED_POLYGONS 1000
+#define BENCH_PACKED_TRANSFORMATIONS 8
+#define BENCH_PACKED_FILE "BENCH.PK"
+#define BENCH_UNPACKED_FILE "BENCH.PLY"
+#define BENCH_LOADS 5
+#define BENCH_PANELS 8
+
+/* Results are printed once the display is back in text mode. */
+static char report_buffer[4096];
+
+static void report(const char *format, ...)
+{
+    va_list arguments;
+    size_t length = strlen(report_buffer);
+
+    va_start(arguments, format);
+    vsprintf(report_buffer + length, format, arguments);
+    va_end(arguments);
+}
+
+/* Returns the average time spent per iteration since a given clock value, in milliseconds. */
+static double elapsed_ms(clock_t start, long iterations)
+{
+    return (clock() - start) * 1000.0 / CLOCKS_PER_SEC / iterations;
+}
+
+static void free_polygons(Polygon **polygons, int polygons_length)
+{
+    int p;
+
+    if (!polygons)
+    {
+        return;
+    }
+
+    /* each block starts with its first polygon */
+    for (p = 0; p < polygons_length; p += BENCH_POLYGON_BLOCK)
+    {
+        free(polygons[p]);
+    }
+
+    free(polygons);
+}
+
+/*
+ * Allocates polygons with a given number of vertices each, in blocks of BENCH_POLYGON_BLOCK polygons followed
+ * by their vertices. Returns an array of pointers to the polygons, or NULL if memory runs out.
+ */
+static Polygon **allocate_polygons(int polygons_length, int vertices_length)
+{
+    Polygon **polygons = malloc(polygons_length * sizeof(*polygons));
+    Polygon *block = NULL;
+    Coordinates *vertices = NULL;
+    int p;
+
+    if (!polygons)
+    {
+        return NULL;
+    }
+
+    for (p = 0; p < polygons_length; p++)
+    {
+        if (p % BENCH_POLYGON_BLOCK == 0)
+        {
+            block = malloc(BENCH_POLYGON_BLOCK * (sizeof(*block) + vertices_length * sizeof(*vertices)));
+
+            if (!block)
+            {
+                free_polygons(polygons, p);
+                return NULL;
+            }
+
+            vertices = (Coordinates *)(block + BENCH_POLYGON_BLOCK);
+        }
+
+        polygons[p] = block + p % BENCH_POLYGON_BLOCK;
+        polygons[p]->vertices = vertices + p % BENCH_POLYGON_BLOCK * vertices_length;
+        polygons[p]->vertices_length = vertices_length;
+    }
+
+    return polygons;
+}
+
+/* Renders a frame of the demo scene, rotating the triangle a little more each time. */
+static void render_demo_frame(GraphicsContext *context, Polygon *rect1, Polygon *rect2, Polygon *triangle)
+{
+    Rectangle background = { { 0, 0 }, { 320, 200 }, 0, 0x01, NULL };
+
+    draw_rectangle(context, background);
+    draw_polygon(context, *rect1);
+    draw_polygon(context, *rect2);
+    draw_polygon(context, *triangle);
+
+    *triangle = rotate_polygon(*triangle, 6.0, AXIS_Z);
+}
+
+/* Measures the frame time with and without capturing presented frames. */
+static void bench_capture(GraphicsContext *context)
+{
+    Coordinates rect1_coords[4] = { { 10, 50 }, { 140, 90 }, { 140, 110 }, { 10, 150 } };
+    Coordinates rect2_coords[4] = { { 310, 50 }, { 180, 90 }, { 180, 110 }, { 310, 150 } };
+    Coordinates triangle_coords[3] = { { 160, 100 }, { 100, 170 }, { 220, 170 } };
+    Polygon rect1_polygon = { NULL, 4, 0x33, 0x33, MATRIX_3X3_IDENTITY };
+    Polygon rect2_polygon = { NULL, 4, 0x33, 0x33, MATRIX_3X3_IDENTITY };
+    Polygon triangle_polygon = { NULL, 3, 0x28, 14, MATRIX_3X3_IDENTITY };
+    Capture capture;
+    clock_t start;
+    double plain_ms, captured_ms;
+    int r;
+
+    rect1_polygon.vertices = rect1_coords;
+    rect2_polygon.vertices = rect2_coords;
+    triangle_polygon.vertices = triangle_coords;
+
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        render_demo_frame(context, &rect1_polygon, &rect2_polygon, &triangle_polygon);
+        update_buffer(context);
+    }
+
+    plain_ms = elapsed_ms(start, BENCH_FRAMES);
+
+    if (!(init_capture(&capture, BENCH_CAPTURE_FILE, CINT(context->screen_size.x), CINT(context->screen_size.y),
+        BENCH_KEYFRAME_INTERVAL)))
+    {
+        report("capture: could not open %s\n", BENCH_CAPTURE_FILE);
+        return;
+    }
+
+    context->capture = &capture;
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        render_demo_frame(context, &rect1_polygon, &rect2_polygon, &triangle_polygon);
+        update_buffer(context);
+    }
+
+    captured_ms = elapsed_ms(start, BENCH_FRAMES);
+    context->capture = NULL;
+    free_capture(&capture);
+
+    if (capture.write_failed)
+    {
+        report("capture: could not write %s, stopped after %lu frames\n", BENCH_CAPTURE_FILE, capture.frames);
+        return;
+    }
+
+    report("capture: %.2f ms/frame plain, %.2f ms/frame captured\n", plain_ms, captured_ms);
+    report("capture: %.2f ms/frame overhead, %lu bytes/frame, %lu keyframes\n",
+        get_capture_overhead(&capture), capture.bytes_written / capture.frames, capture.keyframes);
+}
+
+/* Compares a midpoint circle with the equivalent many-sided polygon. */
+static void bench_ellipses(GraphicsContext *context)
+{
+    Coordinates polygon_coords[BENCH_POLYGON_SIDES];
+    Polygon polygon = { NULL, BENCH_POLYGON_SIDES, 0x28, 14, MATRIX_3X3_IDENTITY };
+    Ellipse circle = { { 160, 100 }, { 60, 60 }, 0x28, 14 };
+    clock_t start;
+    double polygon_ms, circle_ms;
+    int v, r;
+
+    for (v = 0; v < BENCH_POLYGON_SIDES; v++)
+    {
+        polygon_coords[v].x = CROUND(circle.center.x + circle.radius.x * cos(2 * M_PI * v / BENCH_POLYGON_SIDES));
+        polygon_coords[v].y = CROUND(circle.center.y + circle.radius.y * sin(2 * M_PI * v / BENCH_POLYGON_SIDES));
+        polygon_coords[v].z = 0;
+    }
+
+    polygon.vertices = polygon_coords;
+    start = clock();
+
+    for (r = 0; r < BENCH_SHAPES; r++)
+    {
+        draw_polygon(context, polygon);
+    }
+
+    polygon_ms = elapsed_ms(start, BENCH_SHAPES);
+    start = clock();
+
+    for (r = 0; r < BENCH_SHAPES; r++)
+    {
+        draw_ellipse(context, circle);
+    }
+
+    circle_ms = elapsed_ms(start, BENCH_SHAPES);
+
+    report("ellipse: %.3f ms/circle, %.3f ms/%d-gon\n", circle_ms, polygon_ms, BENCH_POLYGON_SIDES);
+}
+
+/* Compares full tilemap redraws with incremental scrolling, presenting frames without waiting for the retrace. */
+static void bench_tilemap(GraphicsContext *context)
+{
+    Tilemap tilemap;
+    clock_t start;
+    double full_ms, scroll_ms;
+    uint i;
+    int r;
+
+    if (!(init_tilemap(&tilemap, BENCH_TILE_SIZE, BENCH_TILE_SIZE, BENCH_TILE_COUNT, BENCH_MAP_SIZE, BENCH_MAP_SIZE)))
+    {
+        report("tilemap: could not allocate tilemap\n");
+        return;
+    }
+
+    /* opaque tiles, with every fourth tile fully transparent and every fourth one partly transparent */
+    for (i = 0; i < BENCH_TILE_SIZE * BENCH_TILE_SIZE * BENCH_TILE_COUNT; i++)
+    {
+        tilemap.tiles[i] = i / (BENCH_TILE_SIZE * BENCH_TILE_SIZE) % 4 == 1 ? 0 :
+            i / (BENCH_TILE_SIZE * BENCH_TILE_SIZE) % 4 == 2 ? (uchar)(i % 2 * (16 + i % 7)) :
+            (uchar)(32 + i % 64);
+    }
+
+    for (i = 0; i < BENCH_MAP_SIZE * BENCH_MAP_SIZE; i++)
+    {
+        tilemap.map[i] = (uchar)((i * 7 + i / BENCH_MAP_SIZE) % BENCH_TILE_COUNT);
+    }
+
+    update_tile_kinds(&tilemap);
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        /* transparent tiles show the background, as with scrolling */
+        _fmemset((void *)(context->off_screen), tilemap.background_color,
+            (ulong)CINT(context->screen_size.x) * CINT(context->screen_size.y));
+        draw_tilemap(context, &tilemap, r, r / 2);
+        present_buffer(context);
+    }
+
+    full_ms = elapsed_ms(start, BENCH_FRAMES);
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        scroll_tilemap(context, &tilemap, r, r / 2);
+        present_buffer(context);
+    }
+
+    scroll_ms = elapsed_ms(start, BENCH_FRAMES);
+    free_tilemap(&tilemap);
+
+    report("tilemap: %.2f ms/frame full redraw, %.2f ms/frame incremental scroll\n", full_ms, scroll_ms);
+}
+
+/* Compares solid and patterned fills of full-screen rectangles. */
+static void bench_patterns(GraphicsContext *context)
+{
+    Rectangle rectangle = { { 0, 0 }, { 320, 200 }, 0x28, 14, NULL };
+    FillPattern pattern;
+    clock_t start;
+    double solid_ms, pattern_ms;
+    int r;
+
+    init_dither_pattern(&pattern, 14, 0x28, DITHER_LEVELS / 3);
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        draw_rectangle(context, rectangle);
+    }
+
+    solid_ms = elapsed_ms(start, BENCH_FRAMES);
+    rectangle.fill_pattern = &pattern;
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        draw_rectangle(context, rectangle);
+    }
+
+    pattern_ms = elapsed_ms(start, BENCH_FRAMES);
+
+    report("pattern: %.2f ms/screen solid fill, %.2f ms/screen dither fill\n", solid_ms, pattern_ms);
+}
+
+/* Compares drawing and hit-testing a large scene with and without a spatial grid. */
+static void bench_spatial(GraphicsContext *context)
+{
+    Polygon **polygons = allocate_polygons(BENCH_SCENE_SHAPES, 3);
+    Matrix3x3 identity = MATRIX_3X3_IDENTITY;
+    SpatialGrid grid;
+    Coordinates origin = { 0, 0, 0 }, point, min, max;
+    clock_t start;
+    double linear_draw_ms, grid_draw_ms, linear_hit_ms, grid_hit_ms;
+    int i, r, found;
+
+    if (!polygons ||
+        !(init_spatial_grid(&grid, origin, BENCH_CELL_SIZE,
+            CINT(context->screen_size.x) * BENCH_SCENE_SCREENS / BENCH_CELL_SIZE,
+            CINT(context->screen_size.y) * BENCH_SCENE_SCREENS / BENCH_CELL_SIZE)))
+    {
+        free_polygons(polygons, BENCH_SCENE_SHAPES);
+        report("spatial: could not allocate scene\n");
+        return;
+    }
+
+    srand(1);
+
+    for (i = 0; i < BENCH_SCENE_SHAPES; i++)
+    {
+        point.x = rand() % CINT(context->screen_size.x * BENCH_SCENE_SCREENS);
+        point.y = rand() % CINT(context->screen_size.y * BENCH_SCENE_SCREENS);
+        point.z = 0;
+
+        polygons[i]->vertices[0] = point;
+        polygons[i]->vertices[1] = point;
+        polygons[i]->vertices[2] = point;
+        polygons[i]->vertices[1].x += 12;
+        polygons[i]->vertices[2].y += 10;
+
+        polygons[i]->border_color = 0x28;
+        polygons[i]->fill_color = 14;
+        polygons[i]->transformation = identity;
+        polygons[i]->fill_pattern = NULL;
+
+        if (add_spatial_polygon(&grid, polygons[i]) == SPATIAL_NONE)
+        {
+            free_spatial_grid(&grid);
+            free_polygons(polygons, BENCH_SCENE_SHAPES);
+            report("spatial: could not index shape %d of %d\n", i, BENCH_SCENE_SHAPES);
+            return;
+        }
+    }
+
+    start = clock();
+
+    for (r = 0; r < BENCH_SCENE_FRAMES; r++)
+    {
+        for (i = 0; i < BENCH_SCENE_SHAPES; i++)
+        {
+            draw_polygon(context, *polygons[i]);
+        }
+    }
+
+    linear_draw_ms = elapsed_ms(start, BENCH_SCENE_FRAMES);
+    start = clock();
+
+    for (r = 0; r < BENCH_SCENE_FRAMES; r++)
+    {
+        draw_spatial_grid(context, &grid);
+    }
+
+    grid_draw_ms = elapsed_ms(start, BENCH_SCENE_FRAMES);
+    srand(2);
+    start = clock();
+
+    /* linear scan of transformed bounding boxes, topmost first */
+    for (r = 0; r < BENCH_HIT_TESTS; r++)
+    {
+        point.x = rand() % CINT(context->screen_size.x * BENCH_SCENE_SCREENS);
+        point.y = rand() % CINT(context->screen_size.y * BENCH_SCENE_SCREENS);
+
+        for (i = BENCH_SCENE_SHAPES - 1, found = SPATIAL_NONE; i >= 0 && found == SPATIAL_NONE; i--)
+        {
+            get_polygon_bounds(polygons[i], &min, &max);
+
+            if (point.x >= min.x && point.x <= max.x && point.y >= min.y && point.y <= max.y)
+            {
+                found = i;
+            }
+        }
+    }
+
+    linear_hit_ms = elapsed_ms(start, BENCH_HIT_TESTS);
+    srand(2);
+    start = clock();
+
+    for (r = 0; r < BENCH_HIT_TESTS; r++)
+    {
+        point.x = rand() % CINT(context->screen_size.x * BENCH_SCENE_SCREENS);
+        point.y = rand() % CINT(context->screen_size.y * BENCH_SCENE_SCREENS);
+
+        query_spatial_point(&grid, point);
+    }
+
+    grid_hit_ms = elapsed_ms(start, BENCH_HIT_TESTS);
+
+    free_spatial_grid(&grid);
+    free_polygons(polygons, BENCH_SCENE_SHAPES);
+
+    report("spatial: %d shapes, %.1f ms/frame linear, %.1f ms/frame culled\n",
+        BENCH_SCENE_SHAPES, linear_draw_ms, grid_draw_ms);
+    report("spatial: %.3f ms/hit-test linear, %.3f ms/hit-test grid\n", linear_hit_ms, grid_hit_ms);
+}
+
+/* Loads polygons stored one by one, allocating the vertices of each polygon separately. */
+static int load_unpacked_polygons(const char *path, Polygon **polygons, int polygons_length)
+{
+    FILE *file = fopen(path, "rb");
+    size_t vertices_size;
+    int p, loaded = 0;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    for (p = 0; p < polygons_length; p++, loaded++)
+    {
+        if (fread(polygons[p], sizeof(*polygons[p]), 1, file) != 1)
+        {
+            break;
+        }
+
+        vertices_size = polygons[p]->vertices_length * sizeof(*polygons[p]->vertices);
+        polygons[p]->vertices = malloc(vertices_size);
+
+        if (!polygons[p]->vertices || fread(polygons[p]->vertices, 1, vertices_size, file) != vertices_size)
+        {
+            free(polygons[p]->vertices);
+            break;
+        }
+    }
+
+    fclose(file);
+    return loaded;
+}
+
+/* Compares the memory and load time of polygons with those of a packed scene. */
+static void bench_packed(void)
+{
+    Polygon **polygons = allocate_polygons(BENCH_PACKED_POLYGONS, 4);
+    Matrix3x3 identity = MATRIX_3X3_IDENTITY;
+    PackedScene scene;
+    FILE *file;
+    clock_t start;
+    ulong unpacked_size, packed_size;
+    double unpacked_ms, packed_ms;
+    int p, v, r, loaded;
+
+    if (!polygons)
+    {
+        report("packed: could not allocate polygons\n");
+        return;
+    }
+
+    srand(1);
+    unpacked_size = (ulong)BENCH_PACKED_POLYGONS * sizeof(**polygons);
+
+    for (p = 0; p < BENCH_PACKED_POLYGONS; p++)
+    {
+        polygons[p]->border_color = 0x28;
+        polygons[p]->fill_color = 14;
+        polygons[p]->transformation = identity;
+        polygons[p]->fill_pattern = NULL;
+        *polygons[p] = rotate_polygon(*polygons[p], p % BENCH_PACKED_TRANSFORMATIONS * 45.0, AXIS_Z);
+        unpacked_size += (ulong)polygons[p]->vertices_length * sizeof(*polygons[p]->vertices);
+
+        for (v = 0; v < 4; v++)
+        {
+            polygons[p]->vertices[v].x = rand() % 320;
+            polygons[p]->vertices[v].y = rand() % 200;
+            polygons[p]->vertices[v].z = 0;
+        }
+    }
+
+    /* write polygons one by one, as the current representation would be stored */
+    if ((file = fopen(BENCH_UNPACKED_FILE, "wb")))
+    {
+        for (p = 0; p < BENCH_PACKED_POLYGONS; p++)
+        {
+            fwrite(polygons[p], sizeof(*polygons[p]), 1, file);
+            fwrite(polygons[p]->vertices, sizeof(*polygons[p]->vertices), polygons[p]->vertices_length, file);
+        }
+
+        fclose(file);
+    }
+
+    if (!(pack_polygons(&scene, polygons, BENCH_PACKED_POLYGONS)) || !(save_packed_scene(&scene, BENCH_PACKED_FILE)))
+    {
+        free_polygons(polygons, BENCH_PACKED_POLYGONS);
+        report("packed: could not write %s\n", BENCH_PACKED_FILE);
+        return;
+    }
+
+    packed_size = get_packed_scene_size(&scene);
+    free_packed_scene(&scene);
+    start = clock();
+
+    for (r = 0; r < BENCH_LOADS; r++)
+    {
+        loaded = load_unpacked_polygons(BENCH_UNPACKED_FILE, polygons, BENCH_PACKED_POLYGONS);
+
+        for (p = 0; p < loaded; p++)
+        {
+            free(polygons[p]->vertices);
+        }
+    }
+
+    unpacked_ms = elapsed_ms(start, BENCH_LOADS);
+    start = clock();
+
+    for (r = 0; r < BENCH_LOADS; r++)
+    {
+        if (load_packed_scene(&scene, BENCH_PACKED_FILE))
+        {
+            free_packed_scene(&scene);
+        }
+    }
+
+    packed_ms = elapsed_ms(start, BENCH_LOADS);
+
+    free_polygons(polygons, BENCH_PACKED_POLYGONS);
+
+    report("packed: %lu bytes/%d polygons unpacked, %lu bytes packed\n",
+        unpacked_size, BENCH_PACKED_POLYGONS, packed_size);
+    report("packed: %.1f ms/load unpacked, %.1f ms/load packed\n", unpacked_ms, packed_ms);
+}
+
+/* Compares stacked opaque panels drawn back to front with the same panels drawn front to back. */
+static void bench_overdraw(GraphicsContext *context)
+{
+    Rectangle panels[BENCH_PANELS];
+    SpanBuffer span_buffer;
+    clock_t start;
+    double back_ms, front_ms;
+    int p, r;
+
+    if (!(init_span_buffer(&span_buffer, CINT(context->screen_size.y))))
+    {
+        report("overdraw: could not allocate span buffer\n");
+        return;
+    }
+
+    /* full-screen background, then panels shrinking toward the center */
+    for (p = 0; p < BENCH_PANELS; p++)
+    {
+        panels[p].offset.x = p * 16;
+        panels[p].offset.y = p * 10;
+        panels[p].dimensions.x = context->screen_size.x - p * 32;
+        panels[p].dimensions.y = context->screen_size.y - p * 20;
+        panels[p].border_color = 0x28;
+        panels[p].fill_color = 16 + p;
+        panels[p].fill_pattern = NULL;
+    }
+
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        for (p = 0; p < BENCH_PANELS; p++)
+        {
+            draw_rectangle(context, panels[p]);
+        }
+    }
+
+    back_ms = elapsed_ms(start, BENCH_FRAMES);
+    context->span_buffer = &span_buffer;
+    start = clock();
+
+    for (r = 0; r < BENCH_FRAMES; r++)
+    {
+        clear_span_buffer(&span_buffer);
+
+        for (p = BENCH_PANELS - 1; p >= 0; p--)
+        {
+            draw_rectangle(context, panels[p]);
+        }
+    }
+
+    front_ms = elapsed_ms(start, BENCH_FRAMES);
+    context->span_buffer = NULL;
+
+    report("overdraw: %.2f ms/frame back to front, %.2f ms/frame front to back\n", back_ms, front_ms);
+    report("overdraw: %lu pixels written, %lu pixels rejected per frame\n",
+        span_buffer.pixels_written, span_buffer.pixels_rejected);
+
+    free_span_buffer(&span_buffer);
+}
+
+int main(void) {
+    GraphicsContext context = { { 0, 0 }, NULL, NULL, NULL, NULL };
+    int initial_bios_mode = get_bios_mode();
+
+    /* enter BIOS mode 13 hex */
+    set_bios_mode(0x13);
+
+    /* initialize the graphics context */
+    if (!(init_context(&context)))
+    {
+        set_bios_mode(initial_bios_mode);
+        printf("Could not initialize off-screen buffer.\n");
+        return 1;
+    }
+
+    bench_capture(&context);
+    bench_ellipses(&context);
+    bench_tilemap(&context);
+    bench_patterns(&context);
+    bench_spatial(&context);
+    bench_packed();
+    bench_overdraw(&context);
+
+    /* free resources */
+    free_context(&context);
+
+    /* return to the previous mode */
+    set_bios_mode(initial_bios_mode);
+    printf("%s", report_buffer);
+    return 0;
+}
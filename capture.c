@@ -0,0 +1,353 @@
+#ifdef __WATCOMC__
+#include <malloc.h>
+#else
+#include <alloc.h>
+#endif
+
+#include <mem.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+/* Writes the pending output to the capture file, discarding it once a write has failed. */
+static void flush_capture(Capture *capture)
+{
+    size_t written;
+
+    if (capture->buffer_length && !capture->write_failed)
+    {
+        written = fwrite(capture->buffer, 1, capture->buffer_length, capture->file);
+        capture->bytes_written += written;
+        capture->write_failed = written != capture->buffer_length;
+    }
+
+    capture->buffer_length = 0;
+}
+
+/* Makes sure that a given number of bytes can be appended to the output buffer. */
+static void reserve_capture(Capture *capture, uint length)
+{
+    if (capture->buffer_length + length > CAPTURE_BUFFER_SIZE)
+    {
+        flush_capture(capture);
+    }
+}
+
+static void put_word(Capture *capture, uint value)
+{
+    capture->buffer[capture->buffer_length++] = value & 0xFF;
+    capture->buffer[capture->buffer_length++] = (value >> 8) & 0xFF;
+}
+
+static int get_word(FILE *file, uint *value)
+{
+    int low = getc(file);
+    int high = getc(file);
+
+    if (low == EOF || high == EOF)
+    {
+        return FALSE;
+    }
+
+    *value = (uint)low | ((uint)high << 8);
+    return TRUE;
+}
+
+/* Packs a sequence of pixels into runs and literals, returning the packed size. */
+static uint pack_pixels(uchar *output, const uchar far *input, uint length)
+{
+    uint i = 0; /* input index */
+    uint written = 0; /* output index */
+    uint start, count; /* first pixel and length of the current run or literal sequence */
+
+    while (i < length)
+    {
+        count = 1;
+
+        while (i + count < length && count < CAPTURE_MAX_RUN && input[i + count] == input[i])
+        {
+            count++;
+        }
+
+        if (count >= CAPTURE_MIN_RUN)
+        {
+            output[written++] = count + 125;
+            output[written++] = input[i];
+            i += count;
+        }
+        else
+        {
+            /* gather literals until the next sequence worth encoding as a run */
+            start = i;
+            count = 0;
+
+            while (i < length && count < CAPTURE_MAX_LITERALS)
+            {
+                if (i + 2 < length && input[i] == input[i + 1] && input[i] == input[i + 2])
+                {
+                    break;
+                }
+
+                i++;
+                count++;
+            }
+
+            output[written++] = count - 1;
+            _fmemcpy((void *)(output + written), (void *)(input + start), count);
+            written += count;
+        }
+    }
+
+    return written;
+}
+
+/* Appends a segment of pixels from a single scanline to the output. */
+static void write_segment(Capture *capture, uint y, uint x, uint length, const uchar far *pixels)
+{
+    /* segment header, and worst case packed size for literals only */
+    reserve_capture(capture, 6 + length + length / CAPTURE_MAX_LITERALS + 1);
+
+    put_word(capture, y);
+    put_word(capture, x);
+    put_word(capture, length);
+
+    capture->buffer_length += pack_pixels(capture->buffer + capture->buffer_length, pixels, length);
+}
+
+/* Writes the runs of a scanline that differ from the previous frame, and updates the latter. */
+static void write_scanline_delta(Capture *capture, uint y, const uchar far *row, uchar far *previous_row)
+{
+    uint x = 0, start, end; /* scan index, and bounds of the current changed run */
+
+    while (x < capture->width)
+    {
+        if (row[x] == previous_row[x])
+        {
+            x++;
+            continue;
+        }
+
+        start = x;
+        end = x + 1;
+
+        /* extend the run across short unchanged gaps, which are cheaper to store than a new segment */
+        for (x = end; x < capture->width && x - end < CAPTURE_MERGE_GAP; x++)
+        {
+            if (row[x] != previous_row[x])
+            {
+                end = x + 1;
+            }
+        }
+
+        write_segment(capture, y, start, end - start, row + start);
+        _fmemcpy((void *)(previous_row + start), (void *)(row + start), end - start);
+    }
+}
+
+int init_capture(Capture *capture, const char *path, uint width, uint height, uint keyframe_interval)
+{
+    memset(capture, 0, sizeof(*capture));
+
+    capture->width = width;
+    capture->height = height;
+    capture->keyframe_interval = keyframe_interval;
+    capture->previous_frame = (uchar *)(farmalloc((ulong)width * height));
+    capture->buffer = malloc(CAPTURE_BUFFER_SIZE);
+    capture->file = fopen(path, "wb");
+
+    if (!capture->previous_frame || !capture->buffer || !capture->file)
+    {
+        free_capture(capture);
+        return 0;
+    }
+
+    memcpy(capture->buffer, CAPTURE_MAGIC, 4);
+    capture->buffer_length = 4;
+    put_word(capture, CAPTURE_VERSION);
+    put_word(capture, width);
+    put_word(capture, height);
+    put_word(capture, keyframe_interval);
+
+    return 1;
+}
+
+void free_capture(Capture *capture)
+{
+    if (capture->file)
+    {
+        if (capture->buffer)
+        {
+            flush_capture(capture);
+        }
+
+        if (fclose(capture->file) == EOF)
+        {
+            capture->write_failed = TRUE;
+        }
+    }
+
+    /* free owned memory */
+    farfree(capture->previous_frame);
+    free(capture->buffer);
+
+    capture->file = NULL;
+    capture->previous_frame = NULL;
+    capture->buffer = NULL;
+}
+
+/* Appends a frame to the capture, as a keyframe or as the difference with the previous frame. */
+void capture_frame(Capture *capture, const uchar far *frame)
+{
+    clock_t start = clock();
+    uint y; /* scanline index */
+    ulong offset; /* offset of the current scanline in the frame */
+    int keyframe = capture->frames == 0 ||
+        (capture->keyframe_interval && capture->frames % capture->keyframe_interval == 0);
+
+    if (capture->write_failed)
+    {
+        return;
+    }
+
+    reserve_capture(capture, 1);
+    capture->buffer[capture->buffer_length++] = keyframe ? CAPTURE_KEYFRAME : CAPTURE_DELTA;
+
+    for (y = 0, offset = 0; y < capture->height; y++, offset += capture->width)
+    {
+        if (keyframe)
+        {
+            write_segment(capture, y, 0, capture->width, frame + offset);
+        }
+        else if (_fmemcmp((void *)(frame + offset), (void *)(capture->previous_frame + offset), capture->width))
+        {
+            write_scanline_delta(capture, y, frame + offset, capture->previous_frame + offset);
+        }
+    }
+
+    if (keyframe)
+    {
+        _fmemcpy((void *)(capture->previous_frame), (void *)(frame), (ulong)capture->width * capture->height);
+        capture->keyframes++;
+    }
+
+    reserve_capture(capture, 2);
+    put_word(capture, CAPTURE_END_OF_FRAME);
+
+    capture->frames++;
+    capture->ticks += clock() - start;
+}
+
+/* Returns the average time spent capturing a frame, in milliseconds. */
+double get_capture_overhead(Capture *capture)
+{
+    if (!capture->frames)
+    {
+        return 0;
+    }
+
+    return capture->ticks * 1000.0 / CLOCKS_PER_SEC / capture->frames;
+}
+
+int init_capture_reader(CaptureReader *reader, const char *path)
+{
+    char magic[4];
+    uint version;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+
+    if (!reader->file)
+    {
+        return 0;
+    }
+
+    if (fread(magic, 1, 4, reader->file) != 4 || memcmp(magic, CAPTURE_MAGIC, 4) ||
+        !get_word(reader->file, &version) || version != CAPTURE_VERSION ||
+        !get_word(reader->file, &reader->width) ||
+        !get_word(reader->file, &reader->height) ||
+        !get_word(reader->file, &reader->keyframe_interval))
+    {
+        free_capture_reader(reader);
+        return 0;
+    }
+
+    return 1;
+}
+
+void free_capture_reader(CaptureReader *reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+/* Decodes the next frame of a capture on top of the previous frame contents. Returns 0 at the end of the stream. */
+int read_capture_frame(CaptureReader *reader, uchar far *frame)
+{
+    uint y = 0, x, length; /* segment header */
+    uint count; /* length of the current run or literal sequence */
+    int control, value; /* packing control byte, and repeated value for runs */
+    uchar far *output; /* points to the frame content being decoded */
+    int type = getc(reader->file);
+
+    if (type != CAPTURE_KEYFRAME && type != CAPTURE_DELTA)
+    {
+        return 0;
+    }
+
+    while (get_word(reader->file, &y) && y != CAPTURE_END_OF_FRAME)
+    {
+        if (!get_word(reader->file, &x) || !get_word(reader->file, &length) ||
+            y >= reader->height || x > reader->width || length > reader->width - x)
+        {
+            return 0;
+        }
+
+        output = frame + (ulong)y * reader->width + x;
+
+        while (length)
+        {
+            if ((control = getc(reader->file)) == EOF)
+            {
+                return 0;
+            }
+
+            count = control < 128 ? control + 1 : control - 125;
+
+            if (count > length)
+            {
+                return 0;
+            }
+
+            if (control < 128)
+            {
+                if (fread((void *)(output), 1, count, reader->file) != count)
+                {
+                    return 0;
+                }
+            }
+            else
+            {
+                if ((value = getc(reader->file)) == EOF)
+                {
+                    return 0;
+                }
+
+                _fmemset((void *)(output), value, count);
+            }
+
+            output += count;
+            length -= count;
+        }
+    }
+
+    if (y != CAPTURE_END_OF_FRAME)
+    {
+        return 0;
+    }
+
+    reader->frames++;
+    return 1;
+}
@@ -0,0 +1,72 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <time.h>
+#include "common.h"
+
+/*
+ * Capture stream format (all 16-bit values are little-endian):
+ *
+ * header:  "DRCP", version, width, height, keyframe interval
+ * frame:   type ('K' for keyframes, 'D' for deltas), followed by segments
+ * segment: y, x, length, then the RLE-packed pixels of the segment
+ *
+ * A frame ends with a segment whose y is CAPTURE_END_OF_FRAME.
+ * Delta frames only hold the scanline runs that changed since the previous frame,
+ * while keyframes hold every scanline, so that playback can start from any keyframe.
+ *
+ * Pixels are packed in runs introduced by a control byte:
+ * values below 128 are followed by (control + 1) literal bytes,
+ * and other values are followed by a single byte repeated (control - 125) times.
+ */
+#define CAPTURE_MAGIC "DRCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_KEYFRAME 'K'
+#define CAPTURE_DELTA 'D'
+#define CAPTURE_END_OF_FRAME 0xFFFF
+
+/* Size of the output buffer, flushed to the file when full. */
+#define CAPTURE_BUFFER_SIZE 8192
+/* Number of unchanged bytes tolerated inside a changed run before it is split. */
+#define CAPTURE_MERGE_GAP 8
+/* Shortest sequence of repeated bytes encoded as a run. */
+#define CAPTURE_MIN_RUN 3
+#define CAPTURE_MAX_RUN 130
+#define CAPTURE_MAX_LITERALS 128
+
+typedef struct Capture
+{
+    FILE *file;
+    uint width;
+    uint height;
+    uint keyframe_interval;
+    uchar far *previous_frame; /* copy of the last captured frame, used for diffing */
+    uchar *buffer; /* pending output, written to the file in large blocks */
+    uint buffer_length;
+    ulong frames;
+    ulong keyframes;
+    ulong bytes_written;
+    int write_failed; /* set when the file could not be written, e.g. on a full disk, which stops the capture */
+    clock_t ticks; /* total time spent capturing frames */
+} Capture;
+
+typedef struct CaptureReader
+{
+    FILE *file;
+    uint width;
+    uint height;
+    uint keyframe_interval;
+    ulong frames;
+} CaptureReader;
+
+int init_capture(Capture *capture, const char *path, uint width, uint height, uint keyframe_interval);
+void free_capture(Capture *capture);
+void capture_frame(Capture *capture, const uchar far *frame);
+double get_capture_overhead(Capture *capture);
+
+int init_capture_reader(CaptureReader *reader, const char *path);
+void free_capture_reader(CaptureReader *reader);
+int read_capture_frame(CaptureReader *reader, uchar far *frame);
+
+#endif /* CAPTURE_H */
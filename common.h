@@ -5,6 +5,14 @@
 #define farfree _ffree
 #define farmalloc _fmalloc
 #define inportb inp
+#define outportb outp
+#define getvect _dos_getvect
+#define setvect _dos_setvect
+#define disable _disable
+#define enable _enable
+#define INTERRUPT __interrupt __far
+#else
+#define INTERRUPT interrupt far
 #endif
 
 #ifndef M_PI
@@ -25,6 +33,7 @@
 #endif
 
 #define uchar unsigned char
+#define ushort unsigned short
 #define uint unsigned int
 #define ulong unsigned long
 
@@ -1,5 +1,23 @@
 #include "graphics.h"
 
+int get_bios_mode(void)
+{
+    union REGS in, out;
+
+    in.h.ah = 0xf;
+    int86(0x10, &in, &out);
+    return out.h.al;
+}
+
+void set_bios_mode(int mode)
+{
+    union REGS in, out;
+
+    in.h.ah = 0x0;
+    in.h.al = mode;
+    int86(0x10, &in, &out);
+}
+
 int init_context(GraphicsContext *context)
 {
     Coordinates screen_size = { 320, 200 }; /* Screen size in the target 13 hex BIOS mode */
@@ -29,17 +47,33 @@ void free_context(GraphicsContext *context)
     _fmemset((void *)(context->screen), 0, ROUND(context->screen_size.x * context->screen_size.y));
 }
 
-void update_buffer(GraphicsContext *context)
+/* Waits for the start of the next vertical retrace. */
+void wait_retrace(void)
 {
-    /* wait a full vertical blank before copying */
     while (inportb(INPUT_STATUS) & 8);
     while (!(inportb(INPUT_STATUS) & 8));
+}
 
-    /* copy the off-screen buffer to the video memory */
+/* Copies the off-screen buffer to the video memory, without waiting for a vertical retrace. */
+void present_buffer(GraphicsContext *context)
+{
     _fmemcpy((void *)(context->screen), (void *)(context->off_screen),
         CINT(context->screen_size.x * context->screen_size.y));
 }
 
+void update_buffer(GraphicsContext *context)
+{
+    /* wait a full vertical blank before copying */
+    wait_retrace();
+    present_buffer(context);
+
+    /* capture after presenting, so that the copy still happens during the vertical blank */
+    if (context->capture)
+    {
+        capture_frame(context->capture, context->off_screen);
+    }
+}
+
 Polygon clone_polygon(Polygon polygon)
 {
     Polygon cloned_polygon = polygon;
@@ -71,6 +105,32 @@ Coordinates get_polygon_centroid(Polygon *polygon)
     return centroid;
 }
 
+/* Computes the bounding box of a polygon after transformation, with inclusive bounds. */
+void get_polygon_bounds(Polygon *polygon, Coordinates *min, Coordinates *max)
+{
+    int v;
+    Coordinates origin = get_polygon_centroid(polygon); /* origin point used to apply transformations */
+    Coordinates vertex; /* transformed vertex */
+
+    for (v = 0; v < polygon->vertices_length; v++)
+    {
+        vertex = apply_transformation(polygon->vertices[v], origin, polygon->transformation);
+
+        if (v == 0)
+        {
+            *min = vertex;
+            *max = vertex;
+        }
+
+        min->x = MIN(vertex.x, min->x);
+        min->y = MIN(vertex.y, min->y);
+        min->z = MIN(vertex.z, min->z);
+        max->x = MAX(vertex.x, max->x);
+        max->y = MAX(vertex.y, max->y);
+        max->z = MAX(vertex.z, max->z);
+    }
+}
+
 /* Transforms a given vertex based on an origin point and a transformation matrix. */
 Coordinates apply_transformation(Coordinates vertex, const Coordinates origin, const Matrix3x3 transformation)
 {
@@ -95,30 +155,98 @@ Coordinates apply_transformation(Coordinates vertex, const Coordinates origin, c
         vertex.x = CROUND(vertex_matrix.data[0]) + origin.x;
         vertex.y = CROUND(vertex_matrix.data[1]) + origin.y;
         vertex.z = CROUND(vertex_matrix.data[2]) + origin.z;
+
+        /* free the product, allocated by the matrix operation */
+        free(vertex_matrix.data);
     }
 
     return vertex;
 }
 
+/* Writes a span with inclusive bounds lying within the screen, using a fill pattern when given. */
+static void write_span(GraphicsContext *context, long y, long x0, long x1, uchar color, const FillPattern *pattern)
+{
+    uchar *buffer = (uchar *)(context->off_screen + CINT(y * context->screen_size.x + x0)); /* points to the screen buffer */
+
+    if (pattern)
+    {
+        fill_pattern_span(buffer, x0, y, x1 - x0 + 1, pattern);
+    }
+    else
+    {
+        _fmemset((void *)(buffer), color, CINT(x1 - x0 + 1));
+    }
+}
+
+/*
+ * Draws a horizontal span between two inclusive horizontal bounds, clipped to the screen.
+ * In front-to-back mode, pixels already covered by the span buffer are left untouched.
+ */
+static void draw_span(GraphicsContext *context, long y, long x0, long x1, uchar color, const FillPattern *pattern)
+{
+    int start, end; /* bounds of the current uncovered run */
+
+    if (y < 0 || y >= context->screen_size.y)
+    {
+        return;
+    }
+
+    x0 = MAX(x0, 0);
+    x1 = MIN(x1, context->screen_size.x - 1);
+
+    if (x0 > x1)
+    {
+        return;
+    }
+
+    if (!context->span_buffer)
+    {
+        write_span(context, y, x0, x1, color, pattern);
+        return;
+    }
+
+    for (start = (int)x0; get_uncovered_span(context->span_buffer, (int)y, &start, (int)x1, &end); start = end + 1)
+    {
+        write_span(context, y, start, end, color, pattern);
+    }
+
+    cover_span(context->span_buffer, (int)y, (int)x0, (int)x1);
+}
+
+/* Draws a single pixel, if it lies within the screen. */
+static void draw_pixel(GraphicsContext *context, long x, long y, uchar color)
+{
+    if (context->span_buffer)
+    {
+        draw_span(context, y, x, x, color, NULL);
+        return;
+    }
+
+    if (x < 0 || y < 0 || x >= context->screen_size.x || y >= context->screen_size.y)
+    {
+        return;
+    }
+
+    *(context->off_screen + CINT(y * context->screen_size.x + x)) = color;
+}
+
 /* Draws a single point on the screen. */
 void draw_point(GraphicsContext *context, Point point)
 {
-    uchar *buffer; /* points to the screen buffer */
     Coordinates p = point.coordinates;
 
-    if (p.x < 0 || p.y < 0 || p.x >= context->screen_size.x || p.y >= context->screen_size.y)
+    /* clip negative coordinates before rounding, which would move them onto the screen */
+    if (p.x < 0 || p.y < 0)
     {
         return;
     }
 
-    buffer = (uchar *)(context->off_screen + ROUND(p.y * context->screen_size.x + p.x));
-    *(buffer) = point.color;
+    draw_pixel(context, CINT(p.x), CINT(p.y), point.color);
 }
 
 /* Draws a straight line between two points, based on Bresenham's algorithm. */
 void draw_line(GraphicsContext *context, Line line)
 {
-    uchar *buffer; /* points to the screen buffer */
     Coordinates delta; /* delta between the points */
     double delta_error; /* error delta per step */
     double error = 0; /* current error */
@@ -151,17 +279,11 @@ void draw_line(GraphicsContext *context, Line line)
         return;
     }
 
-    /* point the buffer to the video memory */
-    buffer = (uchar *)(context->off_screen);
-
     do
     {
         converged = x >= CINT(line.b.x) && y >= CINT(line.b.y);
 
-        if (x >= 0 && y >= 0 && x < context->screen_size.x && y < context->screen_size.y)
-        {
-            *(buffer + CINT(y * context->screen_size.x + x)) = line.color;
-        }
+        draw_pixel(context, x, y, line.color);
 
         error += delta_error;
 
@@ -187,10 +309,12 @@ void draw_line(GraphicsContext *context, Line line)
 void draw_rectangle(GraphicsContext *context, Rectangle rectangle)
 {
     Coordinates overflow, underflow; /* used to avoid drawing outside of the screen */
-    uchar *buffer; /* points to the screen buffer */
+    long x0, x1; /* horizontal bounds of the scanlines, excluding vertical borders */
     uchar line_color; /* holds the color (border or fill) used when drawing a horizontal line */
+    int border_line; /* whether the current line is a horizontal border */
     int y; /* scanline index for the draw loop */
     const int border_size = 1;
+    int left_border, right_border; /* whether each vertical border lies within the screen */
 
     underflow.x = MAX(rectangle.offset.x * -1, 0);
     underflow.y = MAX(rectangle.offset.y * -1, 0);
@@ -205,43 +329,36 @@ void draw_rectangle(GraphicsContext *context, Rectangle rectangle)
         return;
     }
 
-    /* offset the pointer to the video memory */
-    buffer = (uchar *)(context->off_screen +
-        ROUND(rectangle.offset.y * context->screen_size.x + rectangle.offset.x + underflow.x));
+    left_border = rectangle.border_color && rectangle.offset.x >= 0;
+    right_border = rectangle.border_color && rectangle.offset.x + rectangle.dimensions.x >= 0 &&
+        rectangle.offset.x + rectangle.dimensions.x < context->screen_size.x;
+
+    /* scanlines end right before the right border, and exclude the left border when it is drawn */
+    x0 = ROUND(rectangle.offset.x + underflow.x);
+    x1 = x0 + ROUND(rectangle.dimensions.x - overflow.x - underflow.x - border_size) - 1;
+    x0 += left_border;
 
     for (y = -1 * MIN(rectangle.offset.y, 0); y < rectangle.dimensions.y - overflow.y; y++)
     {
         /* draw a full scanline of either the border or the fill color, depending on the current line */
-        line_color =
-            y == 0 || y == (rectangle.dimensions.y - border_size) ?
-            rectangle.border_color : rectangle.fill_color;
+        border_line = y == 0 || y == (rectangle.dimensions.y - border_size);
+        line_color = border_line ? rectangle.border_color : rectangle.fill_color;
 
         if (line_color)
         {
-            /* draw a full horizontal line */
-            _fmemset(
-                (void *)(buffer + ROUND(y * context->screen_size.x)),
-                line_color,
-                ROUND(rectangle.dimensions.x - overflow.x - underflow.x - border_size));
+            draw_span(context, ROUND(rectangle.offset.y + y), x0, x1, line_color,
+                border_line ? NULL : rectangle.fill_pattern);
         }
 
-        /* draw the border */
-        if (rectangle.border_color)
+        /* draw vertical borders (two pixels per scanline) only */
+        if (left_border)
         {
-            /* draw vertical borders (two pixels per scanline) only */
-            if (rectangle.offset.x >= 0 && rectangle.offset.x < context->screen_size.x)
-            {
-                *(buffer + ROUND(y * context->screen_size.x)) = rectangle.border_color;
-            }
+            draw_pixel(context, ROUND(rectangle.offset.x), ROUND(rectangle.offset.y + y), rectangle.border_color);
+        }
 
-            if (rectangle.offset.x + rectangle.dimensions.x >= 0 &&
-                rectangle.offset.x + rectangle.dimensions.x < context->screen_size.x)
-            {
-                *(buffer +
-                    ROUND(y * context->screen_size.x + rectangle.dimensions.x -
-                    overflow.x - underflow.x - border_size)) =
-                    rectangle.border_color;
-            }
+        if (right_border)
+        {
+            draw_pixel(context, x1 + 1, ROUND(rectangle.offset.y + y), rectangle.border_color);
         }
     }
 }
@@ -256,7 +373,7 @@ void draw_polygon(GraphicsContext *context, Polygon polygon)
     int v, w, y; /* index iterating over vertices and scanlines */
     Coordinates origin = get_polygon_centroid(&polygon); /* origin point used to apply transformations */
     Coordinates min, max; /* extrema of the polygon image */
-    uchar *buffer; /* image buffer where to draw the polygon */
+    int fill_first = context->span_buffer && polygon.fill_color; /* draw borders after the fill, in front-to-back mode */
 
     if (polygon.vertices_length < 3)
     {
@@ -283,6 +400,12 @@ void draw_polygon(GraphicsContext *context, Polygon polygon)
         if (polygon.fill_color)
         {
             /* update the polygon's minimum and maximum y coordinates for filling */
+            if (v == 0)
+            {
+                min.y = line.a.y;
+                max.y = line.a.y;
+            }
+
             min.y = MIN(line.b.y, min.y);
             max.y = MAX(line.b.y, max.y);
 
@@ -297,7 +420,7 @@ void draw_polygon(GraphicsContext *context, Polygon polygon)
             }
         }
 
-        if (polygon.border_color)
+        if (polygon.border_color && !fill_first)
         {
             draw_line(context, line);
         }
@@ -305,7 +428,6 @@ void draw_polygon(GraphicsContext *context, Polygon polygon)
 
     if (polygon.fill_color)
     {
-        buffer = (uchar *)(context->off_screen);
         min.y = MAX(min.y, 0);
         max.y = MIN(max.y, context->screen_size.y - 1);
 
@@ -356,16 +478,208 @@ void draw_polygon(GraphicsContext *context, Polygon polygon)
                     min.x = MAX(node_x[v], 0);
                     max.x = MIN(node_x[v + 1], context->screen_size.x - 1);
 
-                    _fmemset(buffer + CINT(y * context->screen_size.x + min.x), polygon.fill_color, CINT(max.x - min.x));
+                    draw_span(context, y, CINT(min.x), CINT(max.x) - 1, polygon.fill_color, polygon.fill_pattern);
                 }
             }
         }
 
+        /*
+         * the fill overwrites the borders when painting, so in front-to-back mode it must cover
+         * its pixels first, otherwise the borders would hide it instead
+         */
+        for (v = 0; fill_first && polygon.border_color && v < polygon.vertices_length; v++)
+        {
+            line.a = transformed_vertices[v];
+            line.b = transformed_vertices[(v + 1) % polygon.vertices_length];
+            draw_line(context, line);
+        }
+
         free(transformed_vertices);
         free(node_x);
     }
 }
 
+/*
+ * Records a point of the first quadrant of an ellipse relative to its center.
+ * Border pixels are drawn in all four quadrants, and the horizontal extent of each scanline is kept
+ * for filling, as the innermost border pixel when there is a border and the outermost pixel otherwise.
+ */
+static void plot_ellipse_point(GraphicsContext *context, Ellipse *ellipse, int *half_widths, long x, long y)
+{
+    long center_x = CINT(ellipse->center.x);
+    long center_y = CINT(ellipse->center.y);
+
+    if (ellipse->border_color)
+    {
+        draw_pixel(context, center_x + x, center_y + y, ellipse->border_color);
+        draw_pixel(context, center_x - x, center_y + y, ellipse->border_color);
+        draw_pixel(context, center_x + x, center_y - y, ellipse->border_color);
+        draw_pixel(context, center_x - x, center_y - y, ellipse->border_color);
+    }
+
+    if (half_widths)
+    {
+        half_widths[y] = ellipse->border_color ? MIN(half_widths[y], x) : MAX(half_widths[y], x);
+    }
+}
+
+/*
+ * Draws a circle or an ellipse, with arbitrary border and fill colors (0 is transparent), based on the midpoint algorithm.
+ * Only the border is drawn if there is not enough memory to fill the ellipse.
+ */
+void draw_ellipse(GraphicsContext *context, Ellipse ellipse)
+{
+    long radius_x = CINT(ellipse.radius.x);
+    long radius_y = CINT(ellipse.radius.y);
+    long center_x = CINT(ellipse.center.x);
+    long center_y = CINT(ellipse.center.y);
+    long x, y; /* current point of the first quadrant, relative to the center */
+    long decision; /* midpoint decision variable of circles */
+    /* the same for ellipses, with gradient terms used to switch from the first region to the second, all of
+       which overflow a long once the product of a squared radius and the other radius reaches 2^30 */
+    double ellipse_decision, step_x, step_y;
+    double square_x = (double)radius_x * radius_x, square_y = (double)radius_y * radius_y;
+    long inner; /* horizontal extent of the fill on a scanline */
+    int *half_widths = NULL; /* horizontal extent of each scanline of the first quadrant, used for filling */
+
+    if (radius_x < 0 || radius_y < 0 || (!ellipse.border_color && !ellipse.fill_color) ||
+        center_x + radius_x < 0 || center_y + radius_y < 0 ||
+        center_x - radius_x >= context->screen_size.x || center_y - radius_y >= context->screen_size.y)
+    {
+        return;
+    }
+
+    if (radius_y == 0)
+    {
+        /* flat ellipse, drawn as a single span */
+        draw_span(context, center_y, center_x - radius_x, center_x + radius_x,
+            ellipse.border_color ? ellipse.border_color : ellipse.fill_color, NULL);
+        return;
+    }
+
+    if (ellipse.fill_color)
+    {
+        /* the extents of the scanlines must fit in a single block, even with a 16-bit size_t */
+        if ((ulong)(radius_y + 1) * sizeof(*half_widths) <= (size_t)-1)
+        {
+            half_widths = malloc((size_t)(radius_y + 1) * sizeof(*half_widths));
+        }
+
+        if (!half_widths)
+        {
+            /* without memory for the fill, fall back to the border alone */
+            if (!ellipse.border_color)
+            {
+                return;
+            }
+
+            ellipse.fill_color = 0;
+        }
+
+        for (y = 0; half_widths && y <= radius_y; y++)
+        {
+            half_widths[y] = ellipse.border_color ? radius_x : -1;
+        }
+    }
+
+    if (radius_x == radius_y)
+    {
+        /* circles only need to be traced over one octant */
+        x = 0;
+        y = radius_y;
+        decision = 1 - radius_y;
+
+        while (x <= y)
+        {
+            plot_ellipse_point(context, &ellipse, half_widths, x, y);
+            plot_ellipse_point(context, &ellipse, half_widths, y, x);
+
+            if (decision < 0)
+            {
+                decision += 2 * x + 3;
+            }
+            else
+            {
+                decision += 2 * (x - y) + 5;
+                y--;
+            }
+
+            x++;
+        }
+    }
+    else
+    {
+        x = 0;
+        y = radius_y;
+        step_x = 0;
+        step_y = 2 * square_x * y;
+        ellipse_decision = square_y - square_x * radius_y + square_x / 4;
+
+        /* first region, where the slope is under 1 and x always increases */
+        while (step_x < step_y)
+        {
+            plot_ellipse_point(context, &ellipse, half_widths, x, y);
+
+            x++;
+            step_x += 2 * square_y;
+
+            if (ellipse_decision < 0)
+            {
+                ellipse_decision += square_y + step_x;
+            }
+            else
+            {
+                y--;
+                step_y -= 2 * square_x;
+                ellipse_decision += square_y + step_x - step_y;
+            }
+        }
+
+        /* second region, where y always decreases */
+        ellipse_decision = square_y * (x + 0.5) * (x + 0.5) + square_x * (y - 1.0) * (y - 1.0) - square_x * square_y;
+
+        while (y >= 0)
+        {
+            plot_ellipse_point(context, &ellipse, half_widths, x, y);
+
+            y--;
+            step_y -= 2 * square_x;
+
+            if (ellipse_decision > 0)
+            {
+                ellipse_decision += square_x - step_y;
+            }
+            else
+            {
+                x++;
+                step_x += 2 * square_y;
+                ellipse_decision += square_x - step_y + step_x;
+            }
+        }
+    }
+
+    if (ellipse.fill_color)
+    {
+        /* fill whole spans between the borders, two scanlines at a time */
+        for (y = 0; y <= radius_y; y++)
+        {
+            inner = ellipse.border_color ? half_widths[y] - 1 : half_widths[y];
+
+            if (inner >= 0)
+            {
+                draw_span(context, center_y - y, center_x - inner, center_x + inner, ellipse.fill_color, NULL);
+
+                if (y)
+                {
+                    draw_span(context, center_y + y, center_x - inner, center_x + inner, ellipse.fill_color, NULL);
+                }
+            }
+        }
+
+        free(half_widths);
+    }
+}
+
 /* Scales a vertex around an origin point. */
 Coordinates scale_vertex(Coordinates vertex, Coordinates origin, double scale_x, double scale_y)
 {
@@ -400,6 +714,7 @@ Rectangle scale_rectangle(Rectangle rectangle, double scale_x, double scale_y)
     scaled_rectangle.dimensions.y = rectangle.dimensions.y * scale_y;
     scaled_rectangle.border_color = rectangle.border_color;
     scaled_rectangle.fill_color = rectangle.fill_color;
+    scaled_rectangle.fill_pattern = rectangle.fill_pattern;
 
     /* handle mirroring */
     if (scale_x < 0)
@@ -433,6 +748,17 @@ Polygon scale_polygon(Polygon polygon, double scale_x, double scale_y)
     return scaled_polygon;
 }
 
+/* Scales an ellipse around its center. Mirroring has no effect on ellipses. */
+Ellipse scale_ellipse(Ellipse ellipse, double scale_x, double scale_y)
+{
+    Ellipse scaled_ellipse = ellipse;
+
+    scaled_ellipse.radius.x = CROUND(ellipse.radius.x * fabs(scale_x));
+    scaled_ellipse.radius.y = CROUND(ellipse.radius.y * fabs(scale_y));
+
+    return scaled_ellipse;
+}
+
 /* Rotates a vertex in the 2D plane around an origin point. */
 Coordinates rotate_vertex(Coordinates vertex, Coordinates origin, double angle)
 {
@@ -12,8 +12,11 @@
 #include <math.h>
 #include <mem.h>
 #include <stdlib.h>
+#include "capture.h"
 #include "common.h"
 #include "matrix.h"
+#include "pattern.h"
+#include "sbuffer.h"
 
 /* Input status port, to check rendering status. */
 #define INPUT_STATUS 0x3DA
@@ -38,6 +41,8 @@ typedef struct GraphicsContext
     Coordinates screen_size;
     uchar far *screen;
     uchar far *off_screen;
+    Capture *capture; /* optional capture of presented frames */
+    SpanBuffer *span_buffer; /* optional coverage of the current frame, for front-to-back rendering */
 } GraphicsContext;
 
 typedef struct Point
@@ -59,6 +64,7 @@ typedef struct Rectangle
     Coordinates dimensions;
     uchar border_color;
     uchar fill_color;
+    const FillPattern *fill_pattern; /* replaces the fill color when set */
 } Rectangle;
 
 typedef struct Polygon
@@ -68,13 +74,29 @@ typedef struct Polygon
     uchar border_color;
     uchar fill_color;
     Matrix3x3 transformation;
+    const FillPattern *fill_pattern; /* replaces the fill color when set */
 } Polygon;
 
+/* Represents an ellipse, or a circle when both radii are equal. */
+typedef struct Ellipse
+{
+    Coordinates center;
+    Coordinates radius;
+    uchar border_color;
+    uchar fill_color;
+} Ellipse;
+
 Polygon clone_polygon(Polygon polygon);
 Coordinates get_polygon_centroid(Polygon *polygon);
+void get_polygon_bounds(Polygon *polygon, Coordinates *min, Coordinates *max);
+
+int get_bios_mode(void);
+void set_bios_mode(int mode);
 
 int init_context(GraphicsContext *context);
 void free_context(GraphicsContext *context);
+void wait_retrace(void);
+void present_buffer(GraphicsContext *context);
 void update_buffer(GraphicsContext *context);
 
 Coordinates apply_transformation(Coordinates vertex, Coordinates origin, Matrix3x3 transformation);
@@ -82,11 +104,13 @@ void draw_point(GraphicsContext *context, Point point);
 void draw_line(GraphicsContext *context, Line line);
 void draw_rectangle(GraphicsContext *context, Rectangle rectangle);
 void draw_polygon(GraphicsContext *context, Polygon polygon);
+void draw_ellipse(GraphicsContext *context, Ellipse ellipse);
 
 Coordinates scale_vertex(Coordinates vertex, Coordinates origin, double scale_x, double scale_y);
 Line scale_line(Line line, double scale_x, double scale_y);
 Rectangle scale_rectangle(Rectangle rectangle, double scale_x, double scale_y);
 Polygon scale_polygon(Polygon polygon, double scale_x, double scale_y);
+Ellipse scale_ellipse(Ellipse ellipse, double scale_x, double scale_y);
 
 Coordinates rotate_vertex(Coordinates vertex, Coordinates origin, double angle);
 Line rotate_line(Line line, double angle);
@@ -1,34 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "graphics.h"
+#include "pacer.h"
 
-int get_bios_mode(void)
-{
-    union REGS in, out;
-
-    in.h.ah = 0xf;
-    int86(0x10, &in, &out);
-    return out.h.al;
-}
-
-void set_bios_mode(int mode)
-{
-    union REGS in, out;
-
-    in.h.ah = 0x0;
-    in.h.al = mode;
-    int86(0x10, &in, &out);
-}
+#define DEMO_ROTATIONS 100
 
 int main(void) {
-    GraphicsContext context = { { 0, 0 }, NULL, NULL };
+    GraphicsContext context = { { 0, 0 }, NULL, NULL, NULL, NULL };
     Coordinates rect1_coords[4] = { { 10, 50 }, { 140, 90 }, { 140, 110 }, { 10, 150 } };
     Coordinates rect2_coords[4] = { { 310, 50 }, { 180, 90 }, { 180, 110 }, { 310, 150 } };
     Coordinates triangle_coords[3] = { { 160, 100 }, { 100, 170 }, { 220, 170 } };
     Polygon rect1_polygon = { NULL, 4, 0x33, 0x33, MATRIX_3X3_IDENTITY };
     Polygon rect2_polygon = { NULL, 4, 0x33, 0x33, MATRIX_3X3_IDENTITY };
     Polygon triangle_polygon = { NULL, 3, 0x28, 14, MATRIX_3X3_IDENTITY };
-    int r;
+    Rectangle background = { { 0, 0 }, { 320, 200 }, 0, 255, NULL };
+    SpanBuffer span_buffer;
+    FramePacer pacer;
+    int rotations = 0, drawn_rotations = -1; /* rotations applied to the triangle, and shown on the last frame drawn */
+    uint u;
 
     int initial_bios_mode = get_bios_mode();
 
@@ -47,32 +36,58 @@ int main(void) {
         return 1;
     }
 
+    /* render front to back, so that each pixel is written once per frame */
+    if (!(init_span_buffer(&span_buffer, CINT(context.screen_size.y))))
+    {
+        free_context(&context);
+        set_bios_mode(initial_bios_mode);
+        printf("Could not initialize span buffer.\n");
+        return 1;
+    }
+
+    context.span_buffer = &span_buffer;
+
     /* transform shapes */
     triangle_polygon = scale_polygon(triangle_polygon, 0.5, 0.5);
     triangle_polygon = rotate_polygon(triangle_polygon, 75.0, AXIS_X);
 
-    /* render graphics */
-    draw_polygon(&context, rect1_polygon);
-    draw_polygon(&context, rect2_polygon);
-    draw_polygon(&context, triangle_polygon);
-
-    update_buffer(&context);
+    /* rotate the triangle once per refresh, presenting frames from the timer interrupt */
+    if (!(init_frame_pacer(&pacer, &context, 1, 4)))
+    {
+        free_span_buffer(&span_buffer);
+        free_context(&context);
+        set_bios_mode(initial_bios_mode);
+        printf("Could not initialize frame pacer.\n");
+        return 1;
+    }
 
-    for (r = 0; r < 100; r++)
+    /* keep going until the last rotation has been drawn and presented */
+    while (drawn_rotations != DEMO_ROTATIONS || !can_draw_frame(&pacer))
     {
-        triangle_polygon.border_color = 255;
-        triangle_polygon.fill_color = 255;
-        draw_polygon(&context, triangle_polygon);
-        triangle_polygon.border_color = 0x28;
-        triangle_polygon.fill_color = 14;
-        triangle_polygon = rotate_polygon(triangle_polygon, 30.0, AXIS_Z);
-        draw_polygon(&context, triangle_polygon);
-        update_buffer(&context);
+        for (u = get_pending_updates(&pacer); u && rotations < DEMO_ROTATIONS; u--, rotations++)
+        {
+            triangle_polygon = rotate_polygon(triangle_polygon, 30.0, AXIS_Z);
+        }
+
+        if (drawn_rotations != rotations && can_draw_frame(&pacer))
+        {
+            /* render graphics, from the nearest shape to the background */
+            clear_span_buffer(&span_buffer);
+            draw_polygon(&context, triangle_polygon);
+            draw_polygon(&context, rect1_polygon);
+            draw_polygon(&context, rect2_polygon);
+            draw_rectangle(&context, background);
+            submit_frame(&pacer);
+
+            drawn_rotations = rotations;
+        }
     }
 
+    free_frame_pacer(&pacer);
     system("PAUSE");
 
     /* free resources */
+    free_span_buffer(&span_buffer);
     free_context(&context);
 
     /* return to the previous mode */
@@ -8,7 +8,7 @@ Matrix matrix_product(Matrix a, Matrix b)
 
     output.rows = a.rows;
     output.columns = b.columns;
-    output.data = malloc(output.rows * output.columns * sizeof(*a.data));
+    output.data = calloc(output.rows * output.columns, sizeof(*a.data));
 
     for (i = 0; i < output.rows; i++)
         for (k = 0; k < valid_size; k++)
@@ -0,0 +1,338 @@
+#include "pacer.h"
+
+#ifndef PACER_SIMULATED
+static FramePacer *active_pacer; /* pacer driven by the timer interrupt */
+static void (INTERRUPT *previous_timer_handler)(void);
+static ulong chain_counts; /* timer counts accumulated toward the next BIOS clock tick */
+
+/* Programs the first timer channel as a rate generator with a given divisor (0 counts 65536). */
+static void program_timer(uint divisor)
+{
+    disable();
+    outportb(PIT_COMMAND, 0x34);
+    outportb(PIT_CHANNEL_0, divisor & 0xFF);
+    outportb(PIT_CHANNEL_0, (divisor >> 8) & 0xFF);
+    enable();
+}
+
+static ushort read_timer(void)
+{
+    uint low, high;
+
+    disable();
+    outportb(PIT_COMMAND, 0x00); /* latch the counter of the first channel */
+    low = inportb(PIT_CHANNEL_0);
+    high = inportb(PIT_CHANNEL_0);
+    enable();
+
+    return (ushort)(low | (high << 8));
+}
+
+/* Measures the average time between two vertical retraces, in timer counts. */
+static uint measure_refresh_period(void)
+{
+    ulong total = 0;
+    ushort start;
+    int f;
+
+    for (f = 0; f < PACER_CALIBRATION_FRAMES; f++)
+    {
+        wait_retrace();
+        start = read_timer();
+        wait_retrace();
+
+        /* the counter runs down and wraps around, but a refresh is shorter than a full count */
+        total += (ushort)(start - read_timer());
+    }
+
+    /* rounded down, so that the timer drifts ahead of the retrace, and realigning only waits briefly */
+    return (uint)(total / PACER_CALIBRATION_FRAMES);
+}
+
+static int vga_in_retrace(void *data)
+{
+    return (inportb(INPUT_STATUS) & 8) != 0;
+}
+
+static void vga_present(void *data)
+{
+    present_buffer((GraphicsContext *)(data));
+}
+#endif
+
+/*
+ * Waits for the vertical retrace to start, then restarts the timer there. Returns FALSE if it does not start
+ * within a fraction of a refresh, which means that the tick came after the retrace rather than ahead of it.
+ */
+static int align_timer(FramePacer *pacer)
+{
+    uint budget = pacer->divisor / PACER_RESYNC_FRACTION;
+    uint waited = 0; /* timer counts spent waiting */
+#ifndef PACER_SIMULATED
+    uint start = pacer->simulated ? 0 : read_timer();
+    uint now;
+#endif
+
+    while (!pacer->display.in_retrace(pacer->display.data))
+    {
+        /* simulated displays take one timer count per test */
+        waited++;
+
+#ifndef PACER_SIMULATED
+        if (!pacer->simulated)
+        {
+            /* the counter runs down from the divisor, then reloads it */
+            now = read_timer();
+            waited = start >= now ? start - now : start + pacer->divisor - now;
+        }
+#endif
+
+        if (waited > budget)
+        {
+            return FALSE;
+        }
+    }
+
+#ifndef PACER_SIMULATED
+    if (!pacer->simulated)
+    {
+        program_timer(pacer->divisor);
+    }
+#endif
+
+    return TRUE;
+}
+
+/*
+ * Realigns the timer after a tick outside of the retrace, then presents the submitted frame, if any.
+ * Frames are kept for the next tick when the retrace is already over, rather than presented with tearing.
+ */
+static void handle_tick(FramePacer *pacer, int drifted)
+{
+    int in_retrace = !drifted;
+
+    if (pacer->busy)
+    {
+        return;
+    }
+
+    pacer->busy = TRUE;
+
+    if (drifted)
+    {
+        if (align_timer(pacer))
+        {
+            pacer->resyncs++;
+            in_retrace = TRUE;
+        }
+        else
+        {
+            pacer->late_ticks++;
+        }
+    }
+
+    if (pacer->frame_ready && in_retrace)
+    {
+        pacer->display.present(pacer->display.data);
+        pacer->frames_presented++;
+        pacer->frame_ready = FALSE;
+    }
+
+    pacer->busy = FALSE;
+}
+
+#ifndef PACER_SIMULATED
+static void INTERRUPT timer_handler(void)
+{
+    FramePacer *pacer = active_pacer;
+    int drifted = !pacer->display.in_retrace(pacer->display.data);
+
+    pacer->ticks++;
+
+    /* keep the BIOS clock running at its usual rate, the previous handler acknowledging the interrupt */
+    chain_counts += pacer->divisor;
+
+    if (chain_counts >= 0x10000UL)
+    {
+        chain_counts -= 0x10000UL;
+        previous_timer_handler();
+    }
+    else
+    {
+        outportb(PIC_COMMAND, PIC_END_OF_INTERRUPT);
+    }
+
+    /* copying a frame may outlast other interrupts, so it runs with interrupts enabled */
+    enable();
+    handle_tick(pacer, drifted);
+}
+#endif
+
+static void reset_frame_pacer(FramePacer *pacer, PacerDisplay display, uint divisor, uint ticks_per_update,
+    uint max_updates)
+{
+    pacer->display = display;
+    pacer->divisor = divisor;
+    pacer->ticks_per_update = MAX(ticks_per_update, 1);
+    pacer->max_updates = MAX(max_updates, 1);
+    pacer->ticks = 0;
+    pacer->frame_ready = FALSE;
+    pacer->busy = FALSE;
+    pacer->update_tick = 0;
+    pacer->updates = 0;
+    pacer->dropped_updates = 0;
+    pacer->frames_presented = 0;
+    pacer->frames_captured = 0;
+    pacer->resyncs = 0;
+    pacer->late_ticks = 0;
+}
+
+#ifndef PACER_SIMULATED
+/* Calibrates the timer to the vertical retrace and installs the timer interrupt. Only one pacer may run at a time. */
+int init_frame_pacer(FramePacer *pacer, GraphicsContext *context, uint ticks_per_update, uint max_updates)
+{
+    PacerDisplay display;
+
+    if (active_pacer)
+    {
+        return 0;
+    }
+
+    display.data = context;
+    display.in_retrace = vga_in_retrace;
+    display.present = vga_present;
+
+    /* rate generator mode counts down one per clock, unlike the square wave mode set up by the BIOS */
+    program_timer(0);
+    reset_frame_pacer(pacer, display, measure_refresh_period(), ticks_per_update, max_updates);
+    pacer->simulated = FALSE;
+
+    if (!pacer->divisor)
+    {
+        free_frame_pacer(pacer);
+        return 0;
+    }
+
+    active_pacer = pacer;
+    chain_counts = 0;
+    previous_timer_handler = getvect(TIMER_INTERRUPT);
+    setvect(TIMER_INTERRUPT, timer_handler);
+
+    /* start the first refresh on time, which waits for up to a full refresh */
+    wait_retrace();
+    program_timer(pacer->divisor);
+
+    return 1;
+}
+#endif
+
+/*
+ * Initializes a pacer which only ticks through tick_simulated_frame_pacer, with a display given by the caller.
+ * Each test of the simulated retrace stands for one timer count, of which the divisor makes a refresh.
+ */
+void init_simulated_frame_pacer(FramePacer *pacer, PacerDisplay display, uint divisor, uint ticks_per_update,
+    uint max_updates)
+{
+    reset_frame_pacer(pacer, display, divisor, ticks_per_update, max_updates);
+    pacer->simulated = TRUE;
+}
+
+/* Restores the timer interrupt and the BIOS timer rate. */
+void free_frame_pacer(FramePacer *pacer)
+{
+#ifndef PACER_SIMULATED
+    if (pacer->simulated)
+    {
+        return;
+    }
+
+    disable();
+    outportb(PIT_COMMAND, 0x36);
+    outportb(PIT_CHANNEL_0, 0);
+    outportb(PIT_CHANNEL_0, 0);
+
+    if (active_pacer == pacer)
+    {
+        setvect(TIMER_INTERRUPT, previous_timer_handler);
+        active_pacer = NULL;
+    }
+
+    enable();
+#endif
+}
+
+/* Simulates the timer interrupt, which is expected at the start of a vertical retrace. */
+void tick_simulated_frame_pacer(FramePacer *pacer)
+{
+    if (pacer->simulated)
+    {
+        pacer->ticks++;
+        handle_tick(pacer, !pacer->display.in_retrace(pacer->display.data));
+    }
+}
+
+ulong get_pacer_ticks(FramePacer *pacer)
+{
+    ulong ticks;
+
+#ifndef PACER_SIMULATED
+    /* the tick count is wider than a machine word, so it must not change while being read */
+    disable();
+    ticks = pacer->ticks;
+    enable();
+#else
+    ticks = pacer->ticks;
+#endif
+
+    return ticks;
+}
+
+/* Returns the number of fixed-timestep updates to run now, dropping the updates beyond max_updates. */
+uint get_pending_updates(FramePacer *pacer)
+{
+    ulong pending = (get_pacer_ticks(pacer) - pacer->update_tick) / pacer->ticks_per_update;
+
+    if (pending > pacer->max_updates)
+    {
+        pacer->dropped_updates += pending - pacer->max_updates;
+        pacer->update_tick += (pending - pacer->max_updates) * pacer->ticks_per_update;
+        pending = pacer->max_updates;
+    }
+
+    pacer->update_tick += pending * pacer->ticks_per_update;
+    pacer->updates += pending;
+
+    return (uint)pending;
+}
+
+/*
+ * Tests whether the off-screen buffer may be drawn to, i.e. the frame submitted last has been presented.
+ * Presented frames are captured here rather than from the interrupt, as capturing writes to a file.
+ */
+int can_draw_frame(FramePacer *pacer)
+{
+#ifndef PACER_SIMULATED
+    GraphicsContext *context = (GraphicsContext *)(pacer->display.data);
+#endif
+
+    if (pacer->frame_ready)
+    {
+        return FALSE;
+    }
+
+#ifndef PACER_SIMULATED
+    if (!pacer->simulated && context->capture && pacer->frames_captured != pacer->frames_presented)
+    {
+        capture_frame(context->capture, context->off_screen);
+        pacer->frames_captured = pacer->frames_presented;
+    }
+#endif
+
+    return TRUE;
+}
+
+/* Marks the off-screen buffer as ready, to be presented at the start of the next vertical retrace. */
+void submit_frame(FramePacer *pacer)
+{
+    pacer->frame_ready = TRUE;
+}
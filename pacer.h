@@ -0,0 +1,92 @@
+#ifndef PACER_H
+#define PACER_H
+
+#ifdef PACER_SIMULATED
+#include "common.h"
+#else
+#include "graphics.h"
+#endif
+
+/* Programmable interval timer and interrupt controller ports. */
+#define PIT_CHANNEL_0 0x40
+#define PIT_COMMAND 0x43
+#define PIC_COMMAND 0x20
+#define PIC_END_OF_INTERRUPT 0x20
+#define TIMER_INTERRUPT 0x08
+
+/* Number of refreshes measured to calibrate the timer to the vertical retrace. */
+#define PACER_CALIBRATION_FRAMES 16
+/* Longest wait for the vertical retrace when realigning the timer, as a fraction of a refresh. */
+#define PACER_RESYNC_FRACTION 16
+
+/* Stands in for the display of a pacer, which is the VGA adapter unless the pacer is simulated. */
+typedef struct PacerDisplay
+{
+    void *data; /* passed to the hooks */
+    int (*in_retrace)(void *data); /* tests whether the display is in its vertical retrace */
+    void (*present)(void *data); /* presents the frame submitted last */
+} PacerDisplay;
+
+/*
+ * Paces frames with a timer interrupt firing at the start of each vertical retrace, instead of busy-waiting.
+ * Each interrupt is a tick: frames submitted since the previous tick are presented from the interrupt,
+ * while the application runs fixed-timestep updates and prepares the next frame:
+ *
+ *     for (;;)
+ *     {
+ *         for (n = get_pending_updates(&pacer); n; n--)
+ *             update();
+ *
+ *         if (can_draw_frame(&pacer))
+ *         {
+ *             draw();
+ *             submit_frame(&pacer);
+ *         }
+ *     }
+ *
+ * Under load, several updates run between two frames, which skips the frames in between, and at most
+ * max_updates run at once, after which the remaining updates are dropped to let the application catch up.
+ *
+ * The off-screen buffer holds the submitted frame until it is presented, so drawing can only start once
+ * can_draw_frame returns TRUE: in the meantime, the application is free to run updates and any other logic.
+ * Drawing ahead would take a second buffer, copied on submission, which costs as much as presenting.
+ *
+ * The timer runs slightly faster than the display, and a tick firing ahead of the retrace realigns it,
+ * waiting at most a fraction of a refresh for the retrace to start.
+ *
+ * A simulated pacer is ticked by hand and uses a display given by the caller, for deterministic tests.
+ * Define PACER_SIMULATED to build only the simulated pacer, without graphics or DOS headers, e.g. on a host.
+ */
+typedef struct FramePacer
+{
+    PacerDisplay display;
+    int simulated;
+    uint divisor; /* timer counts per refresh */
+    uint ticks_per_update; /* fixed timestep, in refreshes */
+    uint max_updates; /* maximum number of updates run at once */
+    volatile ulong ticks; /* refreshes elapsed since the pacer started */
+    volatile int frame_ready; /* whether a submitted frame waits to be presented */
+    volatile int busy; /* guards against handling ticks from nested interrupts */
+    ulong update_tick; /* tick up to which updates were run */
+    ulong updates;
+    ulong dropped_updates;
+    volatile ulong frames_presented;
+    ulong frames_captured;
+    volatile ulong resyncs; /* ticks ahead of the retrace, after which the timer was realigned */
+    volatile ulong late_ticks; /* ticks after the retrace, e.g. serviced late, which were left alone */
+} FramePacer;
+
+#ifndef PACER_SIMULATED
+int init_frame_pacer(FramePacer *pacer, GraphicsContext *context, uint ticks_per_update, uint max_updates);
+#endif
+void init_simulated_frame_pacer(FramePacer *pacer, PacerDisplay display, uint divisor, uint ticks_per_update,
+    uint max_updates);
+void free_frame_pacer(FramePacer *pacer);
+void tick_simulated_frame_pacer(FramePacer *pacer);
+
+ulong get_pacer_ticks(FramePacer *pacer);
+uint get_pending_updates(FramePacer *pacer);
+int can_draw_frame(FramePacer *pacer);
+void submit_frame(FramePacer *pacer);
+
+#endif /* PACER_H */
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include "pacer.h"
+
+#define TEST_TICKS 2000
+#define TEST_REFRESH 17045UL /* timer counts per refresh of the simulated display, close to 70 Hz */
+#define TEST_RETRACE 1000UL /* timer counts spent in the vertical retrace */
+#define TEST_DIVISOR (TEST_REFRESH - 1) /* calibrated divisor, rounded down */
+#define TEST_LATENCY 20UL /* timer counts between a tick and its interrupt handler */
+#define TEST_LATE_LATENCY 3000UL /* same, for ticks serviced late, e.g. behind another interrupt */
+#define TEST_LATE_TICK 200 /* one tick out of this many is serviced late */
+#define TEST_SLOW_FRAME 50 /* one frame out of this many takes several refreshes to draw */
+#define TEST_SLOW_TICKS 6
+#define TEST_MAX_UPDATES 4
+
+/* Simulates a display refreshing at a fixed rate, starting with a vertical retrace at time 0. */
+typedef struct TestDisplay
+{
+    ulong time; /* in timer counts */
+    ulong frames_presented;
+    ulong frames_torn; /* frames presented outside of the retrace */
+} TestDisplay;
+
+static int test_in_retrace(void *data)
+{
+    TestDisplay *display = (TestDisplay *)(data);
+
+    /* each test takes one timer count */
+    return display->time++ % TEST_REFRESH < TEST_RETRACE;
+}
+
+static void test_present(void *data)
+{
+    TestDisplay *display = (TestDisplay *)(data);
+
+    display->frames_torn += display->time % TEST_REFRESH >= TEST_RETRACE;
+    display->frames_presented++;
+}
+
+/*
+ * Checks the frame pacer against a simulated display, with a timer running slightly faster than the display,
+ * ticks serviced late, and frames too slow to draw within a refresh. Builds on a host with PACER_SIMULATED.
+ */
+int main(void)
+{
+    TestDisplay test_display = { 0, 0, 0 };
+    PacerDisplay display;
+    FramePacer pacer;
+    ulong next_tick = 0; /* time of the next timer tick */
+    ulong start, waited, max_resync_wait = 0, max_late_wait = 0;
+    ulong resyncs, frames_submitted = 0, late_ticks = 0;
+    int t, busy_ticks = 0; /* ticks left before the frame being drawn is submitted */
+    int failed;
+
+    display.data = &test_display;
+    display.in_retrace = test_in_retrace;
+    display.present = test_present;
+    init_simulated_frame_pacer(&pacer, display, (uint)TEST_DIVISOR, 1, TEST_MAX_UPDATES);
+
+    for (t = 1; t <= TEST_TICKS; t++)
+    {
+        next_tick += TEST_DIVISOR;
+        test_display.time = next_tick + (t % TEST_LATE_TICK ? TEST_LATENCY : TEST_LATE_LATENCY);
+        late_ticks += t % TEST_LATE_TICK == 0;
+
+        start = test_display.time;
+        resyncs = pacer.resyncs;
+        tick_simulated_frame_pacer(&pacer);
+        waited = test_display.time - start;
+
+        if (pacer.resyncs != resyncs)
+        {
+            /* the timer restarted at the start of the retrace, found by the last test */
+            next_tick = test_display.time - 1;
+            max_resync_wait = MAX(max_resync_wait, waited);
+        }
+        else if (t % TEST_LATE_TICK == 0)
+        {
+            max_late_wait = MAX(max_late_wait, waited);
+        }
+
+        /* the application, which only gets back to its loop once a slow frame is drawn */
+        if (busy_ticks && --busy_ticks)
+        {
+            continue;
+        }
+
+        get_pending_updates(&pacer);
+
+        if (can_draw_frame(&pacer))
+        {
+            submit_frame(&pacer);
+
+            if (++frames_submitted % TEST_SLOW_FRAME == 0)
+            {
+                busy_ticks = TEST_SLOW_TICKS;
+            }
+        }
+    }
+
+    failed =
+        test_display.frames_torn != 0 ||
+        test_display.frames_presented != pacer.frames_presented ||
+        pacer.frames_presented != frames_submitted - pacer.frame_ready ||
+        pacer.resyncs == 0 || max_resync_wait > 2 ||
+        pacer.late_ticks != late_ticks || max_late_wait > TEST_DIVISOR / PACER_RESYNC_FRACTION + 2 ||
+        pacer.dropped_updates == 0 || pacer.updates + pacer.dropped_updates != pacer.update_tick;
+
+    printf("%lu ticks, %lu updates, %lu dropped\n", pacer.ticks, pacer.updates, pacer.dropped_updates);
+    printf("%lu frames submitted, %lu presented, %lu torn\n",
+        frames_submitted, pacer.frames_presented, test_display.frames_torn);
+    printf("%lu resyncs waiting up to %lu counts, %lu late ticks waiting up to %lu counts\n",
+        pacer.resyncs, max_resync_wait, pacer.late_ticks, max_late_wait);
+    printf(failed ? "FAILED\n" : "OK\n");
+
+    return failed;
+}
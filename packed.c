@@ -0,0 +1,266 @@
+#include <string.h>
+#include "packed.h"
+
+/* Largest block a far allocation can hold in real mode. */
+#define MAX_FAR_ALLOCATION 0xFFFFUL
+
+/* Allocates the pools of a scene for given table sizes. */
+static int allocate_packed_scene(PackedScene *scene, uint transformations_length, uint polygons_length, uint vertices_length)
+{
+    ulong polygons_size = (ulong)polygons_length * sizeof(*scene->polygons);
+    ulong vertices_size = (ulong)vertices_length * sizeof(*scene->vertices);
+
+    scene->transformations_length = transformations_length;
+    scene->polygons_length = polygons_length;
+    scene->vertices_length = vertices_length;
+    scene->transformations = NULL;
+    scene->polygons = NULL;
+    scene->vertices = NULL;
+    scene->unpacked_vertices = NULL;
+
+    if (transformations_length > PACKED_MAX_TRANSFORMATIONS ||
+        polygons_size > MAX_FAR_ALLOCATION || vertices_size > MAX_FAR_ALLOCATION)
+    {
+        return 0;
+    }
+
+    /* allocate at least one element per pool, so that empty scenes are valid */
+    scene->transformations = malloc(MAX(transformations_length, 1) * sizeof(*scene->transformations));
+    scene->polygons = (PackedPolygon *)(farmalloc(MAX(polygons_size, 1)));
+    scene->vertices = (PackedVertex *)(farmalloc(MAX(vertices_size, 1)));
+    scene->unpacked_vertices = malloc(PACKED_MAX_VERTICES * sizeof(*scene->unpacked_vertices));
+
+    if (!scene->transformations || !scene->polygons || !scene->vertices || !scene->unpacked_vertices)
+    {
+        free_packed_scene(scene);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Finds a transformation in the table of a scene, or adds it. Returns its index, or -1 if the table is full. */
+static int find_transformation(PackedScene *scene, Matrix3x3 *transformation)
+{
+    uint t;
+
+    for (t = 0; t < scene->transformations_length; t++)
+    {
+        if (!memcmp(&scene->transformations[t], transformation, sizeof(*transformation)))
+        {
+            return t;
+        }
+    }
+
+    if (scene->transformations_length == PACKED_MAX_TRANSFORMATIONS)
+    {
+        return -1;
+    }
+
+    scene->transformations[scene->transformations_length] = *transformation;
+    return scene->transformations_length++;
+}
+
+/* Tests whether the polygon records of a scene only refer to existing vertices and transformations. */
+static int validate_packed_scene(PackedScene *scene)
+{
+    uint p;
+    PackedPolygon far *polygon = scene->polygons;
+
+    for (p = 0; p < scene->polygons_length; p++, polygon++)
+    {
+        if (polygon->transformation >= scene->transformations_length ||
+            (ulong)polygon->first_vertex + polygon->vertices_length > scene->vertices_length)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Builds a packed scene from polygons, sharing identical transformations.
+ * Polygons are passed by pointer, as the records of a large scene do not fit in a single block.
+ */
+int pack_polygons(PackedScene *scene, Polygon **polygons, uint polygons_length)
+{
+    ulong vertices_length = 0;
+    uint p, v; /* polygon and vertex indices */
+    int transformation;
+    Matrix3x3 *transformations; /* shrunk transformation table */
+    PackedVertex far *vertex;
+
+    for (p = 0; p < polygons_length; p++)
+    {
+        if (polygons[p]->vertices_length > PACKED_MAX_VERTICES || polygons[p]->fill_pattern)
+        {
+            return 0;
+        }
+
+        vertices_length += polygons[p]->vertices_length;
+    }
+
+    if (vertices_length > MAX_FAR_ALLOCATION / sizeof(*vertex) ||
+        !allocate_packed_scene(scene, PACKED_MAX_TRANSFORMATIONS, polygons_length, (uint)vertices_length))
+    {
+        return 0;
+    }
+
+    scene->transformations_length = 0;
+    vertex = scene->vertices;
+
+    for (p = 0; p < polygons_length; p++)
+    {
+        if ((transformation = find_transformation(scene, &polygons[p]->transformation)) < 0)
+        {
+            free_packed_scene(scene);
+            return 0;
+        }
+
+        scene->polygons[p].first_vertex = (ushort)(vertex - scene->vertices);
+        scene->polygons[p].vertices_length = (uchar)polygons[p]->vertices_length;
+        scene->polygons[p].transformation = (uchar)transformation;
+        scene->polygons[p].border_color = polygons[p]->border_color;
+        scene->polygons[p].fill_color = polygons[p]->fill_color;
+
+        for (v = 0; v < polygons[p]->vertices_length; v++, vertex++)
+        {
+            vertex->x = (short)CINT(polygons[p]->vertices[v].x);
+            vertex->y = (short)CINT(polygons[p]->vertices[v].y);
+            vertex->z = (short)CINT(polygons[p]->vertices[v].z);
+        }
+    }
+
+    /* release the unused part of the transformation table */
+    transformations = realloc(scene->transformations, MAX(scene->transformations_length, 1) * sizeof(*transformations));
+
+    if (transformations)
+    {
+        scene->transformations = transformations;
+    }
+
+    return 1;
+}
+
+/* Loads a packed scene from a file, reading each pool in a single operation. Scenes with dangling references are rejected. */
+int load_packed_scene(PackedScene *scene, const char *path)
+{
+    char magic[4];
+    ushort header[4]; /* version and table sizes */
+    FILE *file = fopen(path, "rb");
+    int loaded;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, PACKED_MAGIC, 4) ||
+        fread(header, sizeof(*header), 4, file) != 4 || header[0] != PACKED_VERSION ||
+        !allocate_packed_scene(scene, header[1], header[2], header[3]))
+    {
+        fclose(file);
+        return 0;
+    }
+
+    loaded =
+        fread(scene->transformations, sizeof(*scene->transformations), header[1], file) == header[1] &&
+        fread((void *)(scene->polygons), sizeof(*scene->polygons), header[2], file) == header[2] &&
+        fread((void *)(scene->vertices), sizeof(*scene->vertices), header[3], file) == header[3] &&
+        validate_packed_scene(scene);
+
+    fclose(file);
+
+    if (!loaded)
+    {
+        free_packed_scene(scene);
+    }
+
+    return loaded;
+}
+
+int save_packed_scene(PackedScene *scene, const char *path)
+{
+    ushort header[4]; /* version and table sizes */
+    FILE *file = fopen(path, "wb");
+    int saved;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    header[0] = PACKED_VERSION;
+    header[1] = scene->transformations_length;
+    header[2] = scene->polygons_length;
+    header[3] = scene->vertices_length;
+
+    saved =
+        fwrite(PACKED_MAGIC, 1, 4, file) == 4 &&
+        fwrite(header, sizeof(*header), 4, file) == 4 &&
+        fwrite(scene->transformations, sizeof(*scene->transformations), header[1], file) == header[1] &&
+        fwrite((void *)(scene->polygons), sizeof(*scene->polygons), header[2], file) == header[2] &&
+        fwrite((void *)(scene->vertices), sizeof(*scene->vertices), header[3], file) == header[3];
+
+    return fclose(file) == 0 && saved;
+}
+
+void free_packed_scene(PackedScene *scene)
+{
+    /* free owned memory */
+    free(scene->transformations);
+    farfree(scene->polygons);
+    farfree(scene->vertices);
+    free(scene->unpacked_vertices);
+
+    scene->transformations = NULL;
+    scene->polygons = NULL;
+    scene->vertices = NULL;
+    scene->unpacked_vertices = NULL;
+}
+
+/* Returns the memory used by the pools and tables of a scene, in bytes. */
+ulong get_packed_scene_size(PackedScene *scene)
+{
+    return sizeof(*scene) +
+        (ulong)scene->transformations_length * sizeof(*scene->transformations) +
+        (ulong)scene->polygons_length * sizeof(*scene->polygons) +
+        (ulong)scene->vertices_length * sizeof(*scene->vertices) +
+        PACKED_MAX_VERTICES * sizeof(*scene->unpacked_vertices);
+}
+
+/* Expands a packed polygon for drawing. Its vertices are only valid until the next polygon is unpacked. */
+Polygon unpack_polygon(PackedScene *scene, uint index)
+{
+    Polygon polygon;
+    PackedPolygon far *packed_polygon = scene->polygons + index;
+    PackedVertex far *vertex = scene->vertices + packed_polygon->first_vertex;
+    int v;
+
+    for (v = 0; v < packed_polygon->vertices_length; v++, vertex++)
+    {
+        scene->unpacked_vertices[v].x = vertex->x;
+        scene->unpacked_vertices[v].y = vertex->y;
+        scene->unpacked_vertices[v].z = vertex->z;
+    }
+
+    polygon.vertices = scene->unpacked_vertices;
+    polygon.vertices_length = packed_polygon->vertices_length;
+    polygon.border_color = packed_polygon->border_color;
+    polygon.fill_color = packed_polygon->fill_color;
+    polygon.transformation = scene->transformations[packed_polygon->transformation];
+    polygon.fill_pattern = NULL;
+
+    return polygon;
+}
+
+void draw_packed_scene(GraphicsContext *context, PackedScene *scene)
+{
+    uint p;
+
+    for (p = 0; p < scene->polygons_length; p++)
+    {
+        draw_polygon(context, unpack_polygon(scene, p));
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdio.h>
+#include "graphics.h"
+
+/*
+ * Packed scene file format, stored in the native byte order:
+ *
+ * header: "DRPK", version, transformations length, polygons length, vertices length (16 bits each)
+ * then the transformation table, the polygon records and the vertices, as stored in memory.
+ *
+ * Fill patterns are not stored, so polygons with a fill pattern cannot be packed.
+ */
+#define PACKED_MAGIC "DRPK"
+#define PACKED_VERSION 1
+#define PACKED_MAX_TRANSFORMATIONS 256
+#define PACKED_MAX_VERTICES 255 /* per polygon */
+
+typedef struct PackedVertex
+{
+    short x;
+    short y;
+    short z;
+} PackedVertex;
+
+/* Represents a polygon whose vertices and transformation are stored in the tables of a packed scene. */
+typedef struct PackedPolygon
+{
+    ushort first_vertex;
+    uchar vertices_length;
+    uchar transformation;
+    uchar border_color;
+    uchar fill_color;
+} PackedPolygon;
+
+/* Represents a scene of polygons stored in contiguous pools, with transformations shared between polygons. */
+typedef struct PackedScene
+{
+    Matrix3x3 *transformations;
+    PackedPolygon far *polygons;
+    PackedVertex far *vertices;
+    uint transformations_length;
+    uint polygons_length;
+    uint vertices_length;
+    Coordinates *unpacked_vertices; /* vertices of the polygon unpacked last */
+} PackedScene;
+
+int pack_polygons(PackedScene *scene, Polygon **polygons, uint polygons_length);
+int load_packed_scene(PackedScene *scene, const char *path);
+int save_packed_scene(PackedScene *scene, const char *path);
+void free_packed_scene(PackedScene *scene);
+ulong get_packed_scene_size(PackedScene *scene);
+
+Polygon unpack_polygon(PackedScene *scene, uint index);
+void draw_packed_scene(GraphicsContext *context, PackedScene *scene);
+
+#endif /* PACKED_H */
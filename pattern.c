@@ -0,0 +1,92 @@
+#include "pattern.h"
+
+/* Ordered dither thresholds, from 0 to DITHER_LEVELS - 1. */
+static const uchar bayer_matrix[PATTERN_SIZE][PATTERN_SIZE] =
+{
+    { 0, 32, 8, 40, 2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44, 4, 36, 14, 46, 6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    { 3, 35, 11, 43, 1, 33, 9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47, 7, 39, 13, 45, 5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+/* Builds a pattern from rows of pixels, the first row and column being aligned to even screen coordinates. */
+void init_fill_pattern(FillPattern *pattern, const uchar rows[PATTERN_SIZE][PATTERN_SIZE])
+{
+    int x, y; /* pixel indices in the pattern */
+
+    /* pairs of pixels are stored in memory order, i.e. little-endian */
+    for (y = 0; y < PATTERN_SIZE; y++)
+        for (x = 0; x < PATTERN_SIZE; x += 2)
+        {
+            pattern->words[y][x / 2] = rows[y][x] | (rows[y][x + 1] << 8);
+        }
+}
+
+/* Builds an ordered dither between two colors, where level is the amount of the second color out of DITHER_LEVELS. */
+void init_dither_pattern(FillPattern *pattern, uchar color_a, uchar color_b, int level)
+{
+    uchar rows[PATTERN_SIZE][PATTERN_SIZE];
+    int x, y; /* pixel indices in the pattern */
+
+    for (y = 0; y < PATTERN_SIZE; y++)
+        for (x = 0; x < PATTERN_SIZE; x++)
+        {
+            rows[y][x] = bayer_matrix[y][x] < level ? color_b : color_a;
+        }
+
+    init_fill_pattern(pattern, rows);
+}
+
+/* Fills a horizontal span starting at a given screen position with a pattern. */
+void fill_pattern_span(uchar far *buffer, long x, long y, long length, const FillPattern *pattern)
+{
+    const ushort *words = pattern->words[y & (PATTERN_SIZE - 1)];
+    ushort rotated[PATTERN_WORDS]; /* pattern row starting at the first aligned word of the span */
+    ushort far *output; /* points to the screen buffer, one word at a time */
+    int phase, i; /* index of the first word in the pattern row, and word index */
+
+    if (length <= 0)
+    {
+        return;
+    }
+
+    /* leading odd pixel, so that the rest of the span is written with aligned words */
+    if (x & 1)
+    {
+        *(buffer++) = words[(x & (PATTERN_SIZE - 1)) / 2] >> 8;
+        x++;
+        length--;
+    }
+
+    phase = (int)(x & (PATTERN_SIZE - 1)) / 2;
+
+    for (i = 0; i < PATTERN_WORDS; i++)
+    {
+        rotated[i] = words[(phase + i) & (PATTERN_WORDS - 1)];
+    }
+
+    output = (ushort far *)(buffer);
+
+    for (; length >= PATTERN_SIZE; length -= PATTERN_SIZE, output += PATTERN_WORDS)
+    {
+        output[0] = rotated[0];
+        output[1] = rotated[1];
+        output[2] = rotated[2];
+        output[3] = rotated[3];
+    }
+
+    for (i = 0; length >= 2; length -= 2)
+    {
+        *(output++) = rotated[i++];
+    }
+
+    /* trailing odd pixel */
+    if (length)
+    {
+        *((uchar far *)(output)) = rotated[i] & 0xFF;
+    }
+}
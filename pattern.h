@@ -0,0 +1,22 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "common.h"
+
+/* Patterns repeat every 8 pixels in both directions, aligned to the screen. */
+#define PATTERN_SIZE 8
+#define PATTERN_WORDS (PATTERN_SIZE / 2)
+/* Number of levels of a Bayer dither, from the first color only to the second color only. */
+#define DITHER_LEVELS 64
+
+/* Represents an 8x8 fill pattern, stored as pairs of pixels so that spans can be written a word at a time. */
+typedef struct FillPattern
+{
+    ushort words[PATTERN_SIZE][PATTERN_WORDS];
+} FillPattern;
+
+void init_fill_pattern(FillPattern *pattern, const uchar rows[PATTERN_SIZE][PATTERN_SIZE]);
+void init_dither_pattern(FillPattern *pattern, uchar color_a, uchar color_b, int level);
+void fill_pattern_span(uchar far *buffer, long x, long y, long length, const FillPattern *pattern);
+
+#endif /* PATTERN_H */
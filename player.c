@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "graphics.h"
+
+/* Plays back a capture produced with the capture mode of the graphics context. */
+int main(int argc, char *argv[]) {
+    GraphicsContext context = { { 0, 0 }, NULL, NULL, NULL, NULL };
+    CaptureReader reader;
+    int initial_bios_mode;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <capture file>\n", argv[0]);
+        return 1;
+    }
+
+    if (!(init_capture_reader(&reader, argv[1])))
+    {
+        printf("Could not open capture file %s.\n", argv[1]);
+        return 1;
+    }
+
+    initial_bios_mode = get_bios_mode();
+
+    /* enter BIOS mode 13 hex */
+    set_bios_mode(0x13);
+
+    /* initialize the graphics context */
+    if (!(init_context(&context)))
+    {
+        set_bios_mode(initial_bios_mode);
+        free_capture_reader(&reader);
+        printf("Could not initialize off-screen buffer.\n");
+        return 1;
+    }
+
+    if (reader.width != context.screen_size.x || reader.height != context.screen_size.y)
+    {
+        free_context(&context);
+        set_bios_mode(initial_bios_mode);
+        free_capture_reader(&reader);
+        printf("Unsupported capture size %ux%u.\n", reader.width, reader.height);
+        return 1;
+    }
+
+    /* decode frames on top of each other, presenting each one for a single refresh */
+    while (!kbhit() && read_capture_frame(&reader, context.off_screen))
+    {
+        update_buffer(&context);
+    }
+
+    /* free resources */
+    free_context(&context);
+    free_capture_reader(&reader);
+
+    /* return to the previous mode */
+    set_bios_mode(initial_bios_mode);
+    printf("Played %lu frames.\n", reader.frames);
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include "sbuffer.h"
+
+/* Number of spans allocated up front, doubled whenever they run out. */
+#define SPAN_INITIAL_CAPACITY 512
+
+/* Chains spans into the list of unused spans. */
+static void chain_free_spans(SpanBuffer *span_buffer, int first, int last)
+{
+    int s;
+
+    for (s = first; s < last; s++)
+    {
+        span_buffer->spans[s].next = s + 1 < last ? s + 1 : span_buffer->free_span;
+    }
+
+    span_buffer->free_span = first;
+}
+
+static int allocate_span(SpanBuffer *span_buffer)
+{
+    int s;
+    CoveredSpan *spans;
+
+    if (span_buffer->free_span == SPAN_NONE)
+    {
+        /* refuse to grow past what a 16-bit size_t can address, rather than wrapping around */
+        spans = (ulong)span_buffer->spans_capacity * 2 * sizeof(*spans) > (size_t)-1 ? NULL :
+            realloc(span_buffer->spans, (size_t)span_buffer->spans_capacity * 2 * sizeof(*spans));
+
+        if (!spans)
+        {
+            return SPAN_NONE;
+        }
+
+        span_buffer->spans = spans;
+        chain_free_spans(span_buffer, span_buffer->spans_capacity, span_buffer->spans_capacity * 2);
+        span_buffer->spans_capacity *= 2;
+    }
+
+    s = span_buffer->free_span;
+    span_buffer->free_span = span_buffer->spans[s].next;
+
+    return s;
+}
+
+int init_span_buffer(SpanBuffer *span_buffer, int lines_length)
+{
+    span_buffer->lines_length = lines_length;
+    span_buffer->spans_capacity = SPAN_INITIAL_CAPACITY;
+    span_buffer->lines = malloc(lines_length * sizeof(*span_buffer->lines));
+    span_buffer->spans = malloc(span_buffer->spans_capacity * sizeof(*span_buffer->spans));
+
+    if (!span_buffer->lines || !span_buffer->spans)
+    {
+        free_span_buffer(span_buffer);
+        return 0;
+    }
+
+    clear_span_buffer(span_buffer);
+
+    return 1;
+}
+
+void free_span_buffer(SpanBuffer *span_buffer)
+{
+    /* free owned memory */
+    free(span_buffer->lines);
+    free(span_buffer->spans);
+
+    span_buffer->lines = NULL;
+    span_buffer->spans = NULL;
+}
+
+/* Uncovers the whole screen and resets statistics, before drawing a new frame. */
+void clear_span_buffer(SpanBuffer *span_buffer)
+{
+    int y;
+
+    for (y = 0; y < span_buffer->lines_length; y++)
+    {
+        span_buffer->lines[y] = SPAN_NONE;
+    }
+
+    span_buffer->free_span = SPAN_NONE;
+    chain_free_spans(span_buffer, 0, span_buffer->spans_capacity);
+
+    span_buffer->pixels_written = 0;
+    span_buffer->pixels_rejected = 0;
+    span_buffer->overflows = 0;
+}
+
+/*
+ * Finds the first uncovered run of a scanline between *x0 and x1, with inclusive bounds.
+ * Returns FALSE if all of these pixels are covered, otherwise stores the run in *x0 and *end.
+ */
+int get_uncovered_span(SpanBuffer *span_buffer, int y, int *x0, int x1, int *end)
+{
+    int s; /* span index */
+    int x = *x0;
+
+    for (s = span_buffer->lines[y]; s != SPAN_NONE && span_buffer->spans[s].x0 <= x1; s = span_buffer->spans[s].next)
+    {
+        if (span_buffer->spans[s].x1 < x)
+        {
+            continue;
+        }
+
+        if (span_buffer->spans[s].x0 > x)
+        {
+            *x0 = x;
+            *end = span_buffer->spans[s].x0 - 1;
+            return TRUE;
+        }
+
+        x = span_buffer->spans[s].x1 + 1;
+    }
+
+    if (x > x1)
+    {
+        return FALSE;
+    }
+
+    *x0 = x;
+    *end = x1;
+    return TRUE;
+}
+
+/*
+ * Marks a run of a scanline as covered, with inclusive bounds, merging it with the spans it overlaps or touches.
+ * The first of these spans holds the merged span, so that only runs covering new ground take a span.
+ */
+void cover_span(SpanBuffer *span_buffer, int y, int x0, int x1)
+{
+    CoveredSpan *span;
+    int *link = &span_buffer->lines[y]; /* points to the link to the current span */
+    int previous = SPAN_NONE; /* span holding that link, as allocating may move the spans */
+    int s, covered = 0; /* span index, and number of pixels of the run which were already covered */
+    int length = x1 - x0 + 1;
+    int start = x0, end = x1; /* bounds of the merged span */
+    int merged = SPAN_NONE; /* span holding the merged span */
+
+    /* skip spans ending before the run, and not touching it */
+    while (*link != SPAN_NONE && span_buffer->spans[*link].x1 < x0 - 1)
+    {
+        previous = *link;
+        link = &span_buffer->spans[*link].next;
+    }
+
+    /* absorb every span overlapping or touching the run, keeping the first one */
+    while (*link != SPAN_NONE && span_buffer->spans[*link].x0 <= x1 + 1)
+    {
+        s = *link;
+        span = &span_buffer->spans[s];
+        covered += MAX(MIN(x1, span->x1) - MAX(x0, span->x0) + 1, 0);
+        start = MIN(start, span->x0);
+        end = MAX(end, span->x1);
+
+        if (merged == SPAN_NONE)
+        {
+            merged = s;
+            link = &span->next;
+        }
+        else
+        {
+            *link = span->next;
+            span->next = span_buffer->free_span;
+            span_buffer->free_span = s;
+        }
+    }
+
+    if (merged == SPAN_NONE)
+    {
+        merged = allocate_span(span_buffer);
+
+        if (merged == SPAN_NONE)
+        {
+            span_buffer->overflows++;
+            span_buffer->pixels_written += length;
+            return;
+        }
+
+        link = previous == SPAN_NONE ? &span_buffer->lines[y] : &span_buffer->spans[previous].next;
+        span_buffer->spans[merged].next = *link;
+        *link = merged;
+    }
+
+    span_buffer->spans[merged].x0 = start;
+    span_buffer->spans[merged].x1 = end;
+
+    span_buffer->pixels_written += length - covered;
+    span_buffer->pixels_rejected += covered;
+}
@@ -0,0 +1,40 @@
+#ifndef SBUFFER_H
+#define SBUFFER_H
+
+#include "common.h"
+
+/* Marks the end of the span list of a scanline. */
+#define SPAN_NONE -1
+
+/* Represents a horizontal run of covered pixels, with inclusive bounds. */
+typedef struct CoveredSpan
+{
+    int x0;
+    int x1;
+    int next;
+} CoveredSpan;
+
+/*
+ * Represents the screen coverage of a frame drawn front to back, as a sorted list of disjoint spans per scanline.
+ * Pixels already covered are never written again, so each pixel is written at most once per frame.
+ */
+typedef struct SpanBuffer
+{
+    int lines_length;
+    int *lines; /* first span of each scanline */
+    CoveredSpan *spans;
+    int spans_capacity;
+    int free_span; /* first span of the list of unused spans */
+    ulong pixels_written; /* statistics of the current frame */
+    ulong pixels_rejected;
+    ulong overflows; /* spans that could not be recorded, for lack of memory */
+} SpanBuffer;
+
+int init_span_buffer(SpanBuffer *span_buffer, int lines_length);
+void free_span_buffer(SpanBuffer *span_buffer);
+void clear_span_buffer(SpanBuffer *span_buffer);
+
+int get_uncovered_span(SpanBuffer *span_buffer, int y, int *x0, int x1, int *end);
+void cover_span(SpanBuffer *span_buffer, int y, int x0, int x1);
+
+#endif /* SBUFFER_H */
@@ -0,0 +1,448 @@
+#include <limits.h>
+#include "spatial.h"
+
+/* Number of nodes allocated up front, doubled whenever they run out. */
+#define SPATIAL_INITIAL_CAPACITY 64
+
+static int compare_entries(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Doubles the capacity of an array, failing rather than overflowing a 16-bit size_t. The array is kept on failure. */
+static void *grow_array(void *array, int capacity, size_t element_size)
+{
+    if ((ulong)capacity * 2 * element_size > (size_t)-1)
+    {
+        return NULL;
+    }
+
+    return realloc(array, (size_t)capacity * 2 * element_size);
+}
+
+/* Converts a world coordinate to the index of the cell holding it, clamped to the grid. */
+static int get_cell(coord_t value, coord_t origin, int cell_size, int count)
+{
+    long offset = CINT(value - origin);
+
+    if (offset < 0)
+    {
+        return 0;
+    }
+
+    return (int)MIN(offset / cell_size, count - 1);
+}
+
+/* Chains nodes into the list of unused nodes. */
+static void chain_free_nodes(SpatialGrid *grid, int first, int last)
+{
+    int n;
+
+    for (n = first; n < last; n++)
+    {
+        grid->nodes[n].next = n + 1 < last ? n + 1 : grid->free_node;
+    }
+
+    grid->free_node = first;
+}
+
+static int allocate_node(SpatialGrid *grid)
+{
+    int n;
+    SpatialNode *nodes;
+
+    if (grid->free_node == SPATIAL_NONE)
+    {
+        nodes = grow_array(grid->nodes, grid->nodes_capacity, sizeof(*nodes));
+
+        if (!nodes)
+        {
+            return SPATIAL_NONE;
+        }
+
+        grid->nodes = nodes;
+        chain_free_nodes(grid, grid->nodes_capacity, grid->nodes_capacity * 2);
+        grid->nodes_capacity *= 2;
+    }
+
+    n = grid->free_node;
+    grid->free_node = grid->nodes[n].next;
+
+    return n;
+}
+
+/* Recomputes the bounding box of an entry from its shape. */
+static void update_bounds(SpatialEntry *entry)
+{
+    Rectangle *rectangle;
+
+    if (entry->type == SHAPE_RECTANGLE)
+    {
+        rectangle = (Rectangle *)(entry->shape);
+        entry->min = rectangle->offset;
+        entry->max.x = rectangle->offset.x + rectangle->dimensions.x - 1;
+        entry->max.y = rectangle->offset.y + rectangle->dimensions.y - 1;
+        entry->max.z = rectangle->offset.z;
+    }
+    else
+    {
+        get_polygon_bounds((Polygon *)(entry->shape), &entry->min, &entry->max);
+    }
+}
+
+/* Removes an entry from every cell it was inserted in. */
+static void unlink_entry(SpatialGrid *grid, int entry)
+{
+    SpatialEntry *e = get_spatial_entry(grid, entry);
+    int x, y, n; /* cell and node indices */
+    int *link; /* points to the link to the current node */
+
+    for (y = e->cell_min_y; y <= e->cell_max_y; y++)
+        for (x = e->cell_min_x; x <= e->cell_max_x; x++)
+        {
+            for (link = &grid->cells[y * grid->columns + x]; *link != SPATIAL_NONE; link = &grid->nodes[*link].next)
+            {
+                if (grid->nodes[*link].entry == entry)
+                {
+                    n = *link;
+                    *link = grid->nodes[n].next;
+                    grid->nodes[n].next = grid->free_node;
+                    grid->free_node = n;
+                    break;
+                }
+            }
+        }
+}
+
+/* Inserts an entry in every cell covered by its bounding box, or in none of them if memory runs out. */
+static int link_entry(SpatialGrid *grid, int entry)
+{
+    SpatialEntry *e = get_spatial_entry(grid, entry);
+    int x, y, n; /* cell and node indices */
+
+    e->cell_min_x = get_cell(e->min.x, grid->origin.x, grid->cell_size, grid->columns);
+    e->cell_min_y = get_cell(e->min.y, grid->origin.y, grid->cell_size, grid->rows);
+    e->cell_max_x = get_cell(e->max.x, grid->origin.x, grid->cell_size, grid->columns);
+    e->cell_max_y = get_cell(e->max.y, grid->origin.y, grid->cell_size, grid->rows);
+
+    for (y = e->cell_min_y; y <= e->cell_max_y; y++)
+        for (x = e->cell_min_x; x <= e->cell_max_x; x++)
+        {
+            if ((n = allocate_node(grid)) == SPATIAL_NONE)
+            {
+                /* a partly linked entry would be missed by queries in the remaining cells */
+                unlink_entry(grid, entry);
+                return FALSE;
+            }
+
+            grid->nodes[n].entry = entry;
+            grid->nodes[n].next = grid->cells[y * grid->columns + x];
+            grid->cells[y * grid->columns + x] = n;
+        }
+
+    return TRUE;
+}
+
+/* Adds a block of entries, along with the room needed to report them from queries. */
+static int add_entry_block(SpatialGrid *grid)
+{
+    int blocks_length = grid->entry_blocks_length;
+    ulong capacity = (ulong)grid->entries_capacity + SPATIAL_ENTRY_BLOCK;
+    SpatialEntry **entry_blocks;
+    int *results;
+
+    if (capacity > INT_MAX || capacity * sizeof(*results) > (size_t)-1)
+    {
+        return FALSE;
+    }
+
+    entry_blocks = realloc(grid->entry_blocks, (blocks_length + 1) * sizeof(*entry_blocks));
+
+    if (!entry_blocks)
+    {
+        return FALSE;
+    }
+
+    grid->entry_blocks = entry_blocks;
+    results = realloc(grid->results, (size_t)capacity * sizeof(*results));
+
+    if (!results)
+    {
+        return FALSE;
+    }
+
+    grid->results = results;
+
+    if (!(grid->entry_blocks[blocks_length] = malloc(SPATIAL_ENTRY_BLOCK * sizeof(**entry_blocks))))
+    {
+        return FALSE;
+    }
+
+    grid->entry_blocks_length++;
+    grid->entries_capacity = (int)capacity;
+
+    return TRUE;
+}
+
+static int add_spatial_shape(SpatialGrid *grid, ShapeType type, void *shape)
+{
+    int entry = grid->entries_length;
+    SpatialEntry *e;
+
+    if (grid->entries_length == grid->entries_capacity && !add_entry_block(grid))
+    {
+        return SPATIAL_NONE;
+    }
+
+    e = get_spatial_entry(grid, entry);
+    e->type = type;
+    e->shape = shape;
+    e->query = 0;
+    e->active = TRUE;
+
+    update_bounds(e);
+
+    if (!link_entry(grid, entry))
+    {
+        return SPATIAL_NONE;
+    }
+
+    grid->entries_length++;
+
+    return entry;
+}
+
+/* Tests whether a point lies inside a polygon after transformation, based on the even-odd rule. */
+static int point_in_polygon(Polygon *polygon, Coordinates point)
+{
+    int v, inside = FALSE;
+    Coordinates origin = get_polygon_centroid(polygon); /* origin point used to apply transformations */
+    Coordinates a, b; /* transformed ends of the current edge */
+
+    a = apply_transformation(polygon->vertices[polygon->vertices_length - 1], origin, polygon->transformation);
+
+    for (v = 0; v < polygon->vertices_length; v++, a = b)
+    {
+        b = apply_transformation(polygon->vertices[v], origin, polygon->transformation);
+
+        if ((b.y > point.y) != (a.y > point.y) &&
+            point.x < (a.x - b.x) * (point.y - b.y) / (double)(a.y - b.y) + b.x)
+        {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+int init_spatial_grid(SpatialGrid *grid, Coordinates origin, int cell_size, int columns, int rows)
+{
+    int c;
+
+    grid->origin = origin;
+    grid->cell_size = cell_size;
+    grid->columns = columns;
+    grid->rows = rows;
+    grid->entries_length = 0;
+    grid->entries_capacity = 0;
+    grid->entry_blocks = NULL;
+    grid->entry_blocks_length = 0;
+    grid->results = NULL;
+    grid->nodes_capacity = SPATIAL_INITIAL_CAPACITY;
+    grid->free_node = SPATIAL_NONE;
+    grid->query = 0;
+    grid->cells = (ulong)MAX(columns, 0) * MAX(rows, 0) * sizeof(*grid->cells) > (size_t)-1 ? NULL :
+        malloc((size_t)columns * rows * sizeof(*grid->cells));
+    grid->nodes = malloc(grid->nodes_capacity * sizeof(*grid->nodes));
+
+    if (cell_size <= 0 || columns <= 0 || rows <= 0 ||
+        !grid->cells || !grid->nodes || !add_entry_block(grid))
+    {
+        free_spatial_grid(grid);
+        return 0;
+    }
+
+    for (c = 0; c < columns * rows; c++)
+    {
+        grid->cells[c] = SPATIAL_NONE;
+    }
+
+    chain_free_nodes(grid, 0, grid->nodes_capacity);
+
+    return 1;
+}
+
+void free_spatial_grid(SpatialGrid *grid)
+{
+    int b; /* block index */
+
+    /* free owned memory */
+    for (b = 0; b < grid->entry_blocks_length; b++)
+    {
+        free(grid->entry_blocks[b]);
+    }
+
+    free(grid->cells);
+    free(grid->entry_blocks);
+    free(grid->nodes);
+    free(grid->results);
+
+    grid->cells = NULL;
+    grid->entry_blocks = NULL;
+    grid->entry_blocks_length = 0;
+    grid->nodes = NULL;
+    grid->results = NULL;
+}
+
+/* Returns the entry of a shape, from its index. */
+SpatialEntry *get_spatial_entry(SpatialGrid *grid, int entry)
+{
+    return &grid->entry_blocks[entry / SPATIAL_ENTRY_BLOCK][entry % SPATIAL_ENTRY_BLOCK];
+}
+
+/* Indexes a rectangle, returning its entry index, or SPATIAL_NONE if memory ran out. */
+int add_spatial_rectangle(SpatialGrid *grid, Rectangle *rectangle)
+{
+    return add_spatial_shape(grid, SHAPE_RECTANGLE, rectangle);
+}
+
+/* Indexes a polygon, returning its entry index, or SPATIAL_NONE if memory ran out. */
+int add_spatial_polygon(SpatialGrid *grid, Polygon *polygon)
+{
+    return add_spatial_shape(grid, SHAPE_POLYGON, polygon);
+}
+
+/*
+ * Updates the index after a shape moved or its transformation changed. Cells are only updated when they differ.
+ * Returns FALSE if memory ran out, in which case the shape is removed from the index.
+ */
+int update_spatial_shape(SpatialGrid *grid, int entry)
+{
+    SpatialEntry *e = get_spatial_entry(grid, entry);
+
+    if (!e->active)
+    {
+        return TRUE;
+    }
+
+    update_bounds(e);
+
+    if (e->cell_min_x == get_cell(e->min.x, grid->origin.x, grid->cell_size, grid->columns) &&
+        e->cell_min_y == get_cell(e->min.y, grid->origin.y, grid->cell_size, grid->rows) &&
+        e->cell_max_x == get_cell(e->max.x, grid->origin.x, grid->cell_size, grid->columns) &&
+        e->cell_max_y == get_cell(e->max.y, grid->origin.y, grid->cell_size, grid->rows))
+    {
+        return TRUE;
+    }
+
+    unlink_entry(grid, entry);
+
+    if (!link_entry(grid, entry))
+    {
+        e->active = FALSE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Removes a shape from the index. Its entry index is not reused. */
+void remove_spatial_shape(SpatialGrid *grid, int entry)
+{
+    if (get_spatial_entry(grid, entry)->active)
+    {
+        unlink_entry(grid, entry);
+        get_spatial_entry(grid, entry)->active = FALSE;
+    }
+}
+
+/*
+ * Finds the shapes whose bounding box intersects an area with inclusive bounds.
+ * Up to capacity entry indices are stored in results, in drawing order, and their count is returned.
+ */
+int query_spatial_rectangle(SpatialGrid *grid, Coordinates min, Coordinates max, int *results, int capacity)
+{
+    int x, y, n; /* cell and node indices */
+    int count = 0;
+    int cell_max_x = get_cell(max.x, grid->origin.x, grid->cell_size, grid->columns);
+    int cell_max_y = get_cell(max.y, grid->origin.y, grid->cell_size, grid->rows);
+    SpatialEntry *e;
+
+    grid->query++;
+
+    for (y = get_cell(min.y, grid->origin.y, grid->cell_size, grid->rows); y <= cell_max_y; y++)
+        for (x = get_cell(min.x, grid->origin.x, grid->cell_size, grid->columns); x <= cell_max_x; x++)
+            for (n = grid->cells[y * grid->columns + x]; n != SPATIAL_NONE; n = grid->nodes[n].next)
+            {
+                e = get_spatial_entry(grid, grid->nodes[n].entry);
+
+                if (e->query == grid->query)
+                {
+                    continue;
+                }
+
+                e->query = grid->query;
+
+                if (count < capacity &&
+                    e->min.x <= max.x && e->max.x >= min.x && e->min.y <= max.y && e->max.y >= min.y)
+                {
+                    results[count++] = grid->nodes[n].entry;
+                }
+            }
+
+    qsort(results, count, sizeof(*results), compare_entries);
+
+    return count;
+}
+
+/* Finds the topmost shape covering a point, or SPATIAL_NONE. Polygons are tested against their actual outline. */
+int query_spatial_point(SpatialGrid *grid, Coordinates point)
+{
+    int n, entry; /* node and entry indices */
+    int found = SPATIAL_NONE;
+    int x = get_cell(point.x, grid->origin.x, grid->cell_size, grid->columns);
+    int y = get_cell(point.y, grid->origin.y, grid->cell_size, grid->rows);
+    SpatialEntry *e;
+
+    for (n = grid->cells[y * grid->columns + x]; n != SPATIAL_NONE; n = grid->nodes[n].next)
+    {
+        entry = grid->nodes[n].entry;
+        e = get_spatial_entry(grid, entry);
+
+        if (entry > found &&
+            point.x >= e->min.x && point.x <= e->max.x && point.y >= e->min.y && point.y <= e->max.y &&
+            (e->type == SHAPE_RECTANGLE || point_in_polygon((Polygon *)(e->shape), point)))
+        {
+            found = entry;
+        }
+    }
+
+    return found;
+}
+
+/* Draws the shapes of a grid which intersect the screen, in the order they were added. */
+void draw_spatial_grid(GraphicsContext *context, SpatialGrid *grid)
+{
+    Coordinates min = { 0, 0, 0 }, max; /* screen bounds */
+    int count, r;
+    SpatialEntry *e;
+
+    max.x = context->screen_size.x - 1;
+    max.y = context->screen_size.y - 1;
+    max.z = 0;
+    count = query_spatial_rectangle(grid, min, max, grid->results, grid->entries_length);
+
+    for (r = 0; r < count; r++)
+    {
+        e = get_spatial_entry(grid, grid->results[r]);
+
+        if (e->type == SHAPE_RECTANGLE)
+        {
+            draw_rectangle(context, *(Rectangle *)(e->shape));
+        }
+        else
+        {
+            draw_polygon(context, *(Polygon *)(e->shape));
+        }
+    }
+}
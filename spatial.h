@@ -0,0 +1,75 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "graphics.h"
+
+/* Marks the end of a cell list, or a missing entry. */
+#define SPATIAL_NONE -1
+/* Number of entries per block, as a single allocation only holds a thousand entries on 16-bit targets. */
+#define SPATIAL_ENTRY_BLOCK 64
+
+typedef enum ShapeType
+{
+    SHAPE_RECTANGLE,
+    SHAPE_POLYGON
+} ShapeType;
+
+/* Represents a shape indexed by a spatial grid. Shapes are owned by the caller. */
+typedef struct SpatialEntry
+{
+    ShapeType type;
+    void *shape;
+    Coordinates min; /* bounding box after transformation, with inclusive bounds */
+    Coordinates max;
+    int cell_min_x; /* range of grid cells covered by the bounding box */
+    int cell_min_y;
+    int cell_max_x;
+    int cell_max_y;
+    ulong query; /* last query which reported the entry, used to report each entry once */
+    int active;
+} SpatialEntry;
+
+/* Links an entry into the list of a grid cell. */
+typedef struct SpatialNode
+{
+    int entry;
+    int next;
+} SpatialNode;
+
+/*
+ * Represents a uniform grid indexing shapes by bounding box, to cull and hit-test them without visiting every shape.
+ * Shapes outside of the grid are kept in the closest cells along its edges.
+ * Entries are identified by their index, which also gives the drawing order.
+ */
+typedef struct SpatialGrid
+{
+    Coordinates origin; /* world coordinates of the top-left corner of the first cell */
+    int cell_size;
+    int columns;
+    int rows;
+    int *cells; /* first node of each cell */
+    SpatialEntry **entry_blocks; /* entries, in blocks of SPATIAL_ENTRY_BLOCK */
+    int entry_blocks_length;
+    int entries_length;
+    int entries_capacity;
+    SpatialNode *nodes;
+    int nodes_capacity;
+    int free_node; /* first node of the list of unused nodes */
+    int *results; /* scratch space for queries issued by draw_spatial_grid */
+    ulong query;
+} SpatialGrid;
+
+int init_spatial_grid(SpatialGrid *grid, Coordinates origin, int cell_size, int columns, int rows);
+void free_spatial_grid(SpatialGrid *grid);
+
+int add_spatial_rectangle(SpatialGrid *grid, Rectangle *rectangle);
+int add_spatial_polygon(SpatialGrid *grid, Polygon *polygon);
+int update_spatial_shape(SpatialGrid *grid, int entry);
+void remove_spatial_shape(SpatialGrid *grid, int entry);
+SpatialEntry *get_spatial_entry(SpatialGrid *grid, int entry);
+
+int query_spatial_rectangle(SpatialGrid *grid, Coordinates min, Coordinates max, int *results, int capacity);
+int query_spatial_point(SpatialGrid *grid, Coordinates point);
+void draw_spatial_grid(GraphicsContext *context, SpatialGrid *grid);
+
+#endif /* SPATIAL_H */
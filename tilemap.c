@@ -0,0 +1,233 @@
+#include "tilemap.h"
+
+/* Largest block a far allocation can hold in real mode. */
+#define MAX_FAR_ALLOCATION 0xFFFFUL
+
+/* Wraps a pixel offset around a map dimension. */
+static long wrap(long value, long size)
+{
+    value %= size;
+    return value < 0 ? value + size : value;
+}
+
+/* Fills a screen region with the background color, between inclusive top-left and exclusive bottom-right bounds. */
+static void clear_tilemap_region(GraphicsContext *context, Tilemap *tilemap, long left, long top, long right, long bottom)
+{
+    long y;
+
+    for (y = top; y < bottom; y++)
+    {
+        _fmemset((void *)(context->off_screen + CINT(y * context->screen_size.x + left)), tilemap->background_color,
+            right - left);
+    }
+}
+
+/* Renders the tiles covering a screen region, between inclusive top-left and exclusive bottom-right bounds. */
+static void draw_tilemap_region(GraphicsContext *context, Tilemap *tilemap, long left, long top, long right, long bottom)
+{
+    long map_width = (long)tilemap->map_width * tilemap->tile_width; /* map dimensions in pixels */
+    long map_height = (long)tilemap->map_height * tilemap->tile_height;
+    long x, y; /* screen coordinates */
+    long pixel_x, pixel_y; /* map coordinates */
+    uint tile_x, column, row; /* horizontal cell index, and pixel offsets inside the current tile */
+    uint count, i; /* number of pixels copied from the current tile row */
+    uchar tile; /* index of the current tile */
+    uchar far *cells; /* map row of the current scanline */
+    uchar far *source; /* tile row of the current span */
+    uchar far *buffer; /* points to the screen buffer */
+
+    for (y = top; y < bottom; y++)
+    {
+        pixel_y = wrap(tilemap->scroll_y + y, map_height);
+        pixel_x = wrap(tilemap->scroll_x + left, map_width);
+        cells = tilemap->map + (pixel_y / tilemap->tile_height) * tilemap->map_width;
+        row = pixel_y % tilemap->tile_height;
+        tile_x = pixel_x / tilemap->tile_width;
+        column = pixel_x % tilemap->tile_width;
+        buffer = context->off_screen + CINT(y * context->screen_size.x + left);
+
+        for (x = left; x < right; x += count, buffer += count)
+        {
+            count = MIN(tilemap->tile_width - column, right - x);
+            tile = cells[tile_x];
+            source = tilemap->tiles + ((ulong)tile * tilemap->tile_height + row) * tilemap->tile_width + column;
+
+            switch (tilemap->tile_kinds[tile])
+            {
+                case TILE_OPAQUE:
+                _fmemcpy((void *)(buffer), (void *)(source), count);
+                break;
+                case TILE_TRANSPARENT:
+                break;
+                case TILE_MIXED:
+                for (i = 0; i < count; i++)
+                {
+                    if (source[i])
+                    {
+                        buffer[i] = source[i];
+                    }
+                }
+                break;
+            }
+
+            column = 0;
+
+            if (++tile_x == tilemap->map_width)
+            {
+                tile_x = 0;
+            }
+        }
+    }
+}
+
+int init_tilemap(Tilemap *tilemap, uint tile_width, uint tile_height, uint tile_count, uint map_width, uint map_height)
+{
+    ulong tiles_size = (ulong)tile_width * tile_height * tile_count;
+    ulong map_size = (ulong)map_width * map_height;
+
+    tilemap->tile_width = tile_width;
+    tilemap->tile_height = tile_height;
+    tilemap->tile_count = tile_count;
+    tilemap->map_width = map_width;
+    tilemap->map_height = map_height;
+    tilemap->scroll_x = 0;
+    tilemap->scroll_y = 0;
+    tilemap->background_color = 0;
+    tilemap->drawn = FALSE;
+    tilemap->tiles = NULL;
+    tilemap->tile_kinds = NULL;
+    tilemap->map = NULL;
+
+    if (!tiles_size || !map_size || tile_count > 256 ||
+        tiles_size > MAX_FAR_ALLOCATION || map_size > MAX_FAR_ALLOCATION)
+    {
+        return 0;
+    }
+
+    tilemap->tiles = (uchar *)(farmalloc(tiles_size));
+    tilemap->tile_kinds = malloc(tile_count);
+    tilemap->map = (uchar *)(farmalloc(map_size));
+
+    if (!tilemap->tiles || !tilemap->tile_kinds || !tilemap->map)
+    {
+        free_tilemap(tilemap);
+        return 0;
+    }
+
+    _fmemset((void *)(tilemap->tiles), 0, tiles_size);
+    _fmemset((void *)(tilemap->map), 0, map_size);
+    update_tile_kinds(tilemap);
+
+    return 1;
+}
+
+void free_tilemap(Tilemap *tilemap)
+{
+    /* free owned memory */
+    farfree(tilemap->tiles);
+    free(tilemap->tile_kinds);
+    farfree(tilemap->map);
+
+    tilemap->tiles = NULL;
+    tilemap->tile_kinds = NULL;
+    tilemap->map = NULL;
+}
+
+/* Classifies every tile of the atlas. Must be called after changing the atlas contents. */
+void update_tile_kinds(Tilemap *tilemap)
+{
+    uint tile_size = tilemap->tile_width * tilemap->tile_height;
+    uint t, i, opaque; /* tile and pixel indices, and count of opaque pixels in the tile */
+    uchar far *source = tilemap->tiles;
+
+    for (t = 0; t < tilemap->tile_count; t++, source += tile_size)
+    {
+        for (i = 0, opaque = 0; i < tile_size; i++)
+        {
+            opaque += source[i] != 0;
+        }
+
+        tilemap->tile_kinds[t] =
+            opaque == tile_size ? TILE_OPAQUE :
+            opaque == 0 ? TILE_TRANSPARENT : TILE_MIXED;
+    }
+
+    tilemap->drawn = FALSE;
+}
+
+/*
+ * Renders the whole visible window of a tilemap at a given pixel offset. Transparent pixels keep the buffer contents,
+ * so the buffer must be cleared to the background color beforehand for scroll_tilemap to render the same window.
+ */
+void draw_tilemap(GraphicsContext *context, Tilemap *tilemap, long scroll_x, long scroll_y)
+{
+    tilemap->scroll_x = scroll_x;
+    tilemap->scroll_y = scroll_y;
+
+    draw_tilemap_region(context, tilemap, 0, 0, CINT(context->screen_size.x), CINT(context->screen_size.y));
+
+    tilemap->drawn = TRUE;
+}
+
+/*
+ * Renders the visible window of a tilemap at a given pixel offset, reusing the window rendered last.
+ * The off-screen buffer is shifted by the scrolling distance, and only the newly exposed strips are rendered,
+ * over the background color since they hold stale pixels after the shift.
+ * This requires the buffer to be left untouched since the last render, otherwise drawn must be reset beforehand.
+ */
+void scroll_tilemap(GraphicsContext *context, Tilemap *tilemap, long scroll_x, long scroll_y)
+{
+    long width = CINT(context->screen_size.x);
+    long height = CINT(context->screen_size.y);
+    long delta_x = scroll_x - tilemap->scroll_x;
+    long delta_y = scroll_y - tilemap->scroll_y;
+    long shift = delta_y * width + delta_x; /* distance between source and destination pixels in the buffer */
+    long top, bottom; /* rows not covered by the exposed horizontal strip */
+
+    if (!tilemap->drawn || labs(delta_x) >= width || labs(delta_y) >= height)
+    {
+        /* nothing can be reused, so render the whole window over the background */
+        clear_tilemap_region(context, tilemap, 0, 0, width, height);
+        draw_tilemap(context, tilemap, scroll_x, scroll_y);
+        return;
+    }
+
+    if (!shift)
+    {
+        return;
+    }
+
+    /*
+     * shift the buffer as a whole: pixels wrapping around scanlines only land in the exposed
+     * vertical strip, so a single move covers both directions
+     */
+    if (shift > 0)
+    {
+        _fmemmove((void *)(context->off_screen), (void *)(context->off_screen + shift), width * height - shift);
+    }
+    else
+    {
+        _fmemmove((void *)(context->off_screen - shift), (void *)(context->off_screen), width * height + shift);
+    }
+
+    tilemap->scroll_x = scroll_x;
+    tilemap->scroll_y = scroll_y;
+
+    /* exposed horizontal strip */
+    top = delta_y < 0 ? -delta_y : 0;
+    bottom = delta_y > 0 ? height - delta_y : height;
+    clear_tilemap_region(context, tilemap, 0, delta_y > 0 ? bottom : 0, width, delta_y > 0 ? height : top);
+    draw_tilemap_region(context, tilemap, 0, delta_y > 0 ? bottom : 0, width, delta_y > 0 ? height : top);
+
+    /* exposed vertical strip, excluding the rows already rendered */
+    if (delta_x > 0)
+    {
+        clear_tilemap_region(context, tilemap, width - delta_x, top, width, bottom);
+        draw_tilemap_region(context, tilemap, width - delta_x, top, width, bottom);
+    }
+    else if (delta_x < 0)
+    {
+        clear_tilemap_region(context, tilemap, 0, top, -delta_x, bottom);
+        draw_tilemap_region(context, tilemap, 0, top, -delta_x, bottom);
+    }
+}
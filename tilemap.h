@@ -0,0 +1,42 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "graphics.h"
+
+/* Classifies tiles so that fully opaque and fully transparent tiles can skip per-pixel tests. */
+typedef enum TileKind
+{
+    TILE_MIXED,
+    TILE_OPAQUE,
+    TILE_TRANSPARENT
+} TileKind;
+
+/*
+ * Represents a scrolling background made of tiles.
+ * The atlas stores each tile row by row, one after the other, and color 0 is transparent.
+ * The map stores one tile index per cell, row by row, and wraps around in both directions.
+ */
+typedef struct Tilemap
+{
+    uint tile_width;
+    uint tile_height;
+    uint tile_count;
+    uchar far *tiles;
+    uchar *tile_kinds;
+    uint map_width;
+    uint map_height;
+    uchar far *map;
+    long scroll_x; /* pixel offset of the window rendered last */
+    long scroll_y;
+    uchar background_color; /* shown under transparent pixels in the strips exposed by scrolling */
+    int drawn; /* whether the off-screen buffer still holds the window rendered last */
+} Tilemap;
+
+int init_tilemap(Tilemap *tilemap, uint tile_width, uint tile_height, uint tile_count, uint map_width, uint map_height);
+void free_tilemap(Tilemap *tilemap);
+void update_tile_kinds(Tilemap *tilemap);
+
+void draw_tilemap(GraphicsContext *context, Tilemap *tilemap, long scroll_x, long scroll_y);
+void scroll_tilemap(GraphicsContext *context, Tilemap *tilemap, long scroll_x, long scroll_y);
+
+#endif /* TILEMAP_H */